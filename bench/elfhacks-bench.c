@@ -0,0 +1,415 @@
+/**
+ * \file bench/elfhacks-bench.c
+ * \brief times elfhacks lookups and patching, prints JSON
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+/*
+ Use:
+ bench/elfhacks-bench [ops] > result.json
+ bench/elfhacks-compare.py old.json new.json
+
+ Objects measured are libc and the benchsyms_* libraries built next to
+ this program: 10k and 100k symbols, DT_GNU_HASH only and DT_HASH only.
+ Every benchmark runs ops operations BENCH_REPEAT times, the fastest and
+ the median run are reported in nanoseconds per operation.
+
+ Per object:
+  find_obj      - eh_find_obj() + eh_destroy_obj()
+  find_sym      - eh_find_sym() hit, through whatever hash table the
+                  object has ("path")
+  find_sym_miss - eh_find_sym() for a name that is not there
+  find_sym_idx  - eh_find_sym() hit with hash tables hidden, so the
+                  fallback index is used
+  find_syms     - eh_find_syms() batch of BENCH_BATCH, per symbol
+  dlsym         - glibc dlsym() hit on the same names, baseline
+  dlsym_miss    - glibc dlsym() miss
+  index_build   - first lookup on a hashless copy, builds the index
+ Process wide:
+  find_obj_cold - first eh_find_obj() of the process, builds registry
+  iterate_obj   - eh_iterate_obj() with an empty callback
+  iterate_rel   - eh_iterate_rel() over the main program
+  set_rel       - eh_set_rel() on the main program, same value back
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <unistd.h>
+#include "elfhacks.h"
+
+#ifndef ELFHACKS_VER
+# define ELFHACKS_VER "unknown"
+#endif
+
+/** runs per benchmark */
+#define BENCH_REPEAT 7
+
+/** names looked up per object, cycled through */
+#define BENCH_NAMES 1024
+
+/** refs per eh_find_syms() call */
+#define BENCH_BATCH 64
+
+/**
+ * \brief object under test
+ */
+struct bench_obj_s {
+	/** short name used in results */
+	const char *label;
+	/** eh_find_obj() pattern */
+	const char *pattern;
+	/** dlopen() handle */
+	void *handle;
+	/** elfhacks object */
+	eh_obj_t obj;
+	/** defined symbol names, spread over .dynsym */
+	char *names[BENCH_NAMES];
+	/** names that do not exist */
+	char *misses[BENCH_NAMES];
+	/** prehashed names */
+	eh_symref_t refs[BENCH_NAMES];
+	unsigned int nnames;
+};
+
+/**
+ * \brief eh_iterate_sym() state for collecting names
+ */
+struct bench_names_s {
+	struct bench_obj_s *bobj;
+	unsigned int n, step;
+};
+
+static unsigned int ops = 100000;
+static unsigned int nresults;
+
+/* keeps results alive so the compiler does not drop the loops */
+static volatile uintptr_t sink;
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * \brief prints one JSON result
+ * \param sample ns per operation of each run, sorted here
+ */
+static void report(const char *name, const char *object, const char *path,
+		   unsigned int n, double *sample, unsigned int nsamples)
+{
+	qsort(sample, nsamples, sizeof(double), cmp_double);
+	printf("%s\n    {\"name\": \"%s\", \"object\": \"%s\", \"path\": \"%s\", "
+	       "\"ops\": %u, \"ns_min\": %.2f, \"ns_median\": %.2f}",
+	       nresults++ ? "," : "", name, object, path, n,
+	       sample[0], sample[nsamples / 2]);
+}
+
+static int bench_count_syms(eh_sym_t *sym, void *arg)
+{
+	unsigned int *count = arg;
+
+	if (sym->sym->st_shndx != SHN_UNDEF && sym->name[0])
+		(*count)++;
+	return 0;
+}
+
+static int bench_collect_syms(eh_sym_t *sym, void *arg)
+{
+	struct bench_names_s *args = arg;
+	struct bench_obj_s *bobj = args->bobj;
+
+	if (sym->sym->st_shndx == SHN_UNDEF || !sym->name[0])
+		return 0;
+
+	if (args->n++ % args->step || bobj->nnames == BENCH_NAMES)
+		return 0;
+
+	bobj->names[bobj->nnames] = strdup(sym->name);
+	if (asprintf(&bobj->misses[bobj->nnames], "%s_not_here", sym->name) < 0)
+		return ENOMEM;
+	eh_init_symref(&bobj->refs[bobj->nnames], bobj->names[bobj->nnames]);
+	bobj->nnames++;
+
+	return 0;
+}
+
+static const char *bench_path(eh_obj_t *obj)
+{
+	if (obj->gnu_hash)
+		return "gnu";
+	if (obj->hash)
+		return "sysv";
+	return "index";
+}
+
+/**
+ * \brief opens object and picks names to look up
+ */
+static int bench_open(struct bench_obj_s *bobj, const char *file)
+{
+	struct bench_names_s args;
+	unsigned int count = 0;
+
+	bobj->handle = dlopen(file, RTLD_NOW | RTLD_LOCAL);
+	if (!bobj->handle) {
+		fprintf(stderr, "%s\n", dlerror());
+		return 1;
+	}
+
+	if (eh_find_obj(&bobj->obj, bobj->pattern)) {
+		fprintf(stderr, "can't find %s\n", bobj->pattern);
+		return 1;
+	}
+
+	eh_iterate_sym(&bobj->obj, bench_count_syms, &count);
+	args.bobj = bobj;
+	args.n = 0;
+	args.step = count > BENCH_NAMES ? count / BENCH_NAMES : 1;
+	bobj->nnames = 0;
+	eh_iterate_sym(&bobj->obj, bench_collect_syms, &args);
+
+	if (bobj->nnames == 0) {
+		fprintf(stderr, "%s has no symbols\n", bobj->label);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void bench_object(struct bench_obj_s *bobj)
+{
+	double sample[BENCH_REPEAT];
+	unsigned int r, i, j, n, batch;
+	void *to[BENCH_BATCH];
+	eh_obj_t obj;
+	uint64_t t;
+
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		n = ops / 100 + 1;
+		t = now();
+		for (i = 0; i < n; i++) {
+			eh_find_obj(&obj, bobj->pattern);
+			eh_destroy_obj(&obj);
+		}
+		sample[r] = (double) (now() - t) / n;
+	}
+	report("find_obj", bobj->label, bench_path(&bobj->obj), n, sample, BENCH_REPEAT);
+
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		t = now();
+		for (i = 0; i < ops; i++) {
+			eh_find_sym(&bobj->obj, bobj->names[i % bobj->nnames], &to[0]);
+			sink += (uintptr_t) to[0];
+		}
+		sample[r] = (double) (now() - t) / ops;
+	}
+	report("find_sym", bobj->label, bench_path(&bobj->obj), ops, sample, BENCH_REPEAT);
+
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		t = now();
+		for (i = 0; i < ops; i++) {
+			eh_find_sym(&bobj->obj, bobj->misses[i % bobj->nnames], &to[0]);
+			sink += (uintptr_t) to[0];
+		}
+		sample[r] = (double) (now() - t) / ops;
+	}
+	report("find_sym_miss", bobj->label, bench_path(&bobj->obj), ops, sample, BENCH_REPEAT);
+
+	/* hashless copy keeps nsyms counted above, first lookup builds the index */
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		obj = bobj->obj;
+		obj.hash = NULL;
+		obj.gnu_hash = NULL;
+		obj.index = NULL;
+		t = now();
+		eh_find_sym(&obj, bobj->names[0], &to[0]);
+		sample[r] = (double) (now() - t);
+		sink += (uintptr_t) to[0];
+		eh_destroy_obj(&obj);
+	}
+	report("index_build", bobj->label, "index", 1, sample, BENCH_REPEAT);
+
+	obj = bobj->obj;
+	obj.hash = NULL;
+	obj.gnu_hash = NULL;
+	obj.index = NULL;
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		t = now();
+		for (i = 0; i < ops; i++) {
+			eh_find_sym(&obj, bobj->names[i % bobj->nnames], &to[0]);
+			sink += (uintptr_t) to[0];
+		}
+		sample[r] = (double) (now() - t) / ops;
+	}
+	eh_destroy_obj(&obj);
+	report("find_sym_idx", bobj->label, "index", ops, sample, BENCH_REPEAT);
+
+	batch = bobj->nnames < BENCH_BATCH ? bobj->nnames : BENCH_BATCH;
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		n = 0;
+		t = now();
+		for (i = 0; i < ops; i += batch) {
+			j = i % (bobj->nnames - batch + 1);
+			eh_find_syms(&bobj->obj, &bobj->refs[j], batch, to);
+			sink += (uintptr_t) to[0];
+			n += batch;
+		}
+		sample[r] = (double) (now() - t) / n;
+	}
+	report("find_syms", bobj->label, bench_path(&bobj->obj), n, sample, BENCH_REPEAT);
+
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		t = now();
+		for (i = 0; i < ops; i++)
+			sink += (uintptr_t) dlsym(bobj->handle, bobj->names[i % bobj->nnames]);
+		sample[r] = (double) (now() - t) / ops;
+	}
+	report("dlsym", bobj->label, "glibc", ops, sample, BENCH_REPEAT);
+
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		t = now();
+		for (i = 0; i < ops; i++)
+			sink += (uintptr_t) dlsym(bobj->handle, bobj->misses[i % bobj->nnames]);
+		sample[r] = (double) (now() - t) / ops;
+	}
+	report("dlsym_miss", bobj->label, "glibc", ops, sample, BENCH_REPEAT);
+}
+
+static int bench_iterate_obj_callback(eh_obj_t *obj, void *arg)
+{
+	(*(unsigned int *) arg)++;
+	return 0;
+}
+
+static int bench_iterate_rel_callback(eh_rel_t *rel, void *arg)
+{
+	(*(unsigned int *) arg)++;
+	return 0;
+}
+
+static void bench_process(void)
+{
+	double sample[BENCH_REPEAT];
+	unsigned int r, i, n, count = 0;
+	eh_obj_t main_obj;
+	void *val;
+	uint64_t t;
+
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		n = ops / 100 + 1;
+		t = now();
+		for (i = 0; i < n; i++)
+			eh_iterate_obj(bench_iterate_obj_callback, &count);
+		sample[r] = (double) (now() - t) / n;
+	}
+	report("iterate_obj", "process", "registry", n, sample, BENCH_REPEAT);
+
+	if (eh_find_obj(&main_obj, NULL)) {
+		fprintf(stderr, "can't find main program\n");
+		return;
+	}
+
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		n = ops / 10 + 1;
+		t = now();
+		for (i = 0; i < n; i++)
+			eh_iterate_rel(&main_obj, bench_iterate_rel_callback, &count);
+		sample[r] = (double) (now() - t) / n;
+	}
+	report("iterate_rel", "main", bench_path(&main_obj), n, sample, BENCH_REPEAT);
+
+	/* patch an import with the value it already resolves to */
+	val = dlsym(RTLD_DEFAULT, "eh_destroy_obj");
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		n = ops / 10 + 1;
+		t = now();
+		for (i = 0; i < n; i++)
+			eh_set_rel(&main_obj, "eh_destroy_obj", val);
+		sample[r] = (double) (now() - t) / n;
+	}
+	report("set_rel", "main", bench_path(&main_obj), n, sample, BENCH_REPEAT);
+
+	eh_destroy_obj(&main_obj);
+	sink += count;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *synthetic[] = { "gnu_10000", "sysv_10000", "gnu_100000", "sysv_100000" };
+	struct bench_obj_s bobj[5];
+	char dir[PATH_MAX], file[PATH_MAX + 64], *slash;
+	unsigned int nobj = 0, i;
+	double cold;
+	eh_obj_t obj;
+	uint64_t t;
+	ssize_t len;
+
+	/* nothing has touched the registry yet */
+	t = now();
+	eh_find_obj(&obj, "*libc.so*");
+	cold = (double) (now() - t);
+	eh_destroy_obj(&obj);
+
+	if (argc > 1 && (ops = atoi(argv[1])) == 0)
+		ops = 100000;
+
+	len = readlink("/proc/self/exe", dir, sizeof(dir) - 1);
+	if (len < 0) {
+		perror("/proc/self/exe");
+		return 1;
+	}
+	dir[len] = '\0';
+	slash = strrchr(dir, '/');
+	if (slash)
+		*slash = '\0';
+
+	memset(bobj, 0, sizeof(bobj));
+	bobj[nobj].label = "libc";
+	bobj[nobj].pattern = "*libc.so*";
+	if (bench_open(&bobj[nobj], "libc.so.6"))
+		return 1;
+	nobj++;
+
+	for (i = 0; i < sizeof(synthetic) / sizeof(synthetic[0]); i++) {
+		snprintf(file, sizeof(file), "%s/libbenchsyms_%s.so", dir, synthetic[i]);
+		bobj[nobj].label = strrchr(file, '/') + 1;
+		if (asprintf((char **) &bobj[nobj].pattern, "*%s*", bobj[nobj].label) < 0 ||
+		    !(bobj[nobj].label = strdup(bobj[nobj].label)))
+			return 1;
+		if (bench_open(&bobj[nobj], file))
+			return 1;
+		nobj++;
+	}
+
+	printf("{\n  \"version\": \"%s\",\n  \"ops\": %u,\n  \"repeat\": %u,\n  \"results\": [",
+	       ELFHACKS_VER, ops, BENCH_REPEAT);
+
+	report("find_obj_cold", "process", "registry", 1, &cold, 1);
+	bench_process();
+	for (i = 0; i < nobj; i++)
+		bench_object(&bobj[i]);
+
+	printf("\n  ]\n}\n");
+
+	return 0;
+}
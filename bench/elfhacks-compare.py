@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+#
+# Compares two elfhacks-bench results, exits non-zero on regressions.
+#
+# Use:
+# elfhacks-compare.py old.json new.json [threshold %]
+#
+# Medians are compared; a benchmark regresses when it got slower by more
+# than threshold percent (default 10).
+
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return data, {(r["name"], r["object"]): r for r in data["results"]}
+
+
+def main(argv):
+    if len(argv) < 3:
+        sys.stderr.write("usage: %s old.json new.json [threshold %%]\n" % argv[0])
+        return 2
+
+    threshold = float(argv[3]) if len(argv) > 3 else 10.0
+    old_data, old = load(argv[1])
+    new_data, new = load(argv[2])
+    regressions = 0
+
+    print("%-14s %-28s %12s %12s %8s" % ("bench", "object", old_data["version"],
+                                         new_data["version"], "change"))
+    for key in sorted(new):
+        if key not in old:
+            continue
+        a = old[key]["ns_median"]
+        b = new[key]["ns_median"]
+        change = (b - a) * 100.0 / a if a else 0.0
+        mark = ""
+        if change > threshold:
+            mark = " <-"
+            regressions += 1
+        print("%-14s %-28s %12.1f %12.1f %+7.1f%%%s" % (key[0], key[1], a, b, change, mark))
+
+    if regressions:
+        print("%d regressions over %.0f%%" % (regressions, threshold))
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,674 @@
+/**
+ * \file bench/fakegl.c
+ * \brief stand-in libGL.so.1 with a simulated GPU queue
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+/*
+ Environment:
+ FAKEGL_GPU_US    - GPU time of one frame (default 4000)
+ FAKEGL_JITTER_US - frames take FAKEGL_GPU_US +- this, uniformly (default 0)
+ FAKEGL_SEED      - jitter sequence seed, same seed gives same costs (default 1)
+ FAKEGL_QUEUE     - frames the application may run ahead of the display
+                    before glXSwapBuffers() blocks (default 2)
+ FAKEGL_REFRESH_HZ - display refresh rate (default 60)
+ FAKEGL_SWAP_INTERVAL - initial swap interval, 0 shows frames as soon as
+                    the GPU finishes them (default 0)
+ FAKEGL_OML       - set to 0 to fail GLX_OML_sync_control calls, as drivers
+                    without it do (default 1)
+
+ Simulated timeline is computed from job costs, not from when the GPU
+ thread happens to wake up, so completion times only depend on when jobs
+ are submitted.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <GL/glx.h>
+#include "fakegl.h"
+
+/** query objects, ids are 1 .. FAKEGL_MAX_QUERIES */
+#define FAKEGL_MAX_QUERIES 4096
+
+/**
+ * \brief fence, signaled once value jobs are complete
+ */
+struct fakegl_sync_s {
+	uint64_t value;
+};
+
+/**
+ * \brief timestamp query
+ */
+struct fakegl_query_s {
+	/** jobs that must complete before the GPU reaches the query */
+	uint64_t value;
+	/** when the query was issued */
+	uint64_t issued;
+	/** glQueryCounter() has been called */
+	int used;
+};
+
+/**
+ * \brief fake GPU state, everything guarded by mutex
+ */
+struct fakegl_gpu_s {
+	pthread_mutex_t mutex;
+	/** signaled on every completed job */
+	pthread_cond_t done_cond;
+	/** signaled on every submitted job */
+	pthread_cond_t submit_cond;
+	pthread_t thread;
+
+	uint64_t gpu_ns, jitter_ns;
+	uint64_t seed;
+	unsigned int queue;
+
+	/** refresh period, first vblank is at vblank_base */
+	uint64_t refresh_ns, vblank_base;
+	/** swap interval, read when a frame completes */
+	int interval;
+	/** GLX_OML_sync_control calls succeed */
+	int oml;
+	/** frames shown so far, the swap buffer count of GLX_OML_sync_control */
+	uint64_t shown;
+
+	/** jobs submitted and completed so far */
+	uint64_t submitted, completed;
+	/** per job submit time, cost, completion and presentation time */
+	uint64_t *submit, *cost, *done, *present;
+	/** simulated completion and presentation time of the last completed job */
+	uint64_t last_done, last_present;
+
+	struct fakegl_query_s query[FAKEGL_MAX_QUERIES];
+	unsigned int next_query;
+};
+
+static struct fakegl_gpu_s fakegl_gpu = {
+	PTHREAD_MUTEX_INITIALIZER
+};
+
+static pthread_once_t fakegl_once = PTHREAD_ONCE_INIT;
+
+/** current context of calling thread */
+static __thread GLXContext fakegl_current;
+
+static uint64_t fakegl_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t fakegl_getenv_us(const char *name, uint64_t def)
+{
+	const char *val = getenv(name);
+
+	return val ? strtoull(val, NULL, 10) * 1000ull : def * 1000ull;
+}
+
+/**
+ * \brief xorshift64*, deterministic for given FAKEGL_SEED
+ */
+static uint64_t fakegl_random(struct fakegl_gpu_s *gpu)
+{
+	gpu->seed ^= gpu->seed >> 12;
+	gpu->seed ^= gpu->seed << 25;
+	gpu->seed ^= gpu->seed >> 27;
+	return gpu->seed * 0x2545f4914f6cdd1dull;
+}
+
+static void fakegl_sleep_until(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000ull;
+	ts.tv_nsec = t % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+		;
+}
+
+/**
+ * \brief waits on cond until deadline, UINT64_MAX waits forever
+ */
+static void fakegl_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, uint64_t deadline)
+{
+	struct timespec ts;
+
+	if (deadline == UINT64_MAX) {
+		pthread_cond_wait(cond, mutex);
+		return;
+	}
+
+	ts.tv_sec = deadline / 1000000000ull;
+	ts.tv_nsec = deadline % 1000000000ull;
+	pthread_cond_timedwait(cond, mutex, &ts);
+}
+
+/**
+ * \brief returns first vblank at or after t
+ */
+static uint64_t fakegl_vblank_after(struct fakegl_gpu_s *gpu, uint64_t t)
+{
+	if (t <= gpu->vblank_base)
+		return gpu->vblank_base;
+	return gpu->vblank_base + (t - gpu->vblank_base + gpu->refresh_ns - 1) / gpu->refresh_ns * gpu->refresh_ns;
+}
+
+/**
+ * \brief executes jobs in submission order
+ *
+ * With a swap interval every job is a frame shown at the first vblank
+ * after it completes, at least interval refreshes after the previous one.
+ */
+static void *fakegl_gpu_thread(void *arg)
+{
+	struct fakegl_gpu_s *gpu = arg;
+	uint64_t job, start, end;
+
+	pthread_mutex_lock(&gpu->mutex);
+	for (;;) {
+		while (gpu->completed == gpu->submitted)
+			pthread_cond_wait(&gpu->submit_cond, &gpu->mutex);
+
+		job = gpu->completed % FAKEGL_MAX_JOBS;
+		start = gpu->submit[job] > gpu->last_done ? gpu->submit[job] : gpu->last_done;
+		end = start + gpu->cost[job];
+		pthread_mutex_unlock(&gpu->mutex);
+
+		fakegl_sleep_until(end);
+
+		pthread_mutex_lock(&gpu->mutex);
+		gpu->done[job] = end;
+		gpu->last_done = end;
+		if (gpu->interval > 0) {
+			if (gpu->last_present + gpu->interval * gpu->refresh_ns > end)
+				end = gpu->last_present + gpu->interval * gpu->refresh_ns;
+			end = fakegl_vblank_after(gpu, end);
+		}
+		gpu->present[job] = end;
+		gpu->last_present = end;
+		gpu->completed++;
+		pthread_cond_broadcast(&gpu->done_cond);
+	}
+
+	return NULL;
+}
+
+static void fakegl_init(void)
+{
+	struct fakegl_gpu_s *gpu = &fakegl_gpu;
+	pthread_condattr_t attr;
+	const char *val;
+
+	gpu->gpu_ns = fakegl_getenv_us("FAKEGL_GPU_US", 4000);
+	gpu->jitter_ns = fakegl_getenv_us("FAKEGL_JITTER_US", 0);
+	if (gpu->jitter_ns > gpu->gpu_ns)
+		gpu->jitter_ns = gpu->gpu_ns;
+	val = getenv("FAKEGL_SEED");
+	gpu->seed = val ? strtoull(val, NULL, 10) : 1;
+	if (gpu->seed == 0)
+		gpu->seed = 1;
+	val = getenv("FAKEGL_QUEUE");
+	gpu->queue = val ? atoi(val) : 2;
+	val = getenv("FAKEGL_REFRESH_HZ");
+	gpu->refresh_ns = 1000000000ull / (val && atoi(val) > 0 ? atoi(val) : 60);
+	val = getenv("FAKEGL_SWAP_INTERVAL");
+	gpu->interval = val ? atoi(val) : 0;
+	val = getenv("FAKEGL_OML");
+	gpu->oml = val ? atoi(val) : 1;
+	gpu->vblank_base = fakegl_now();
+
+	gpu->submit = calloc(FAKEGL_MAX_JOBS, sizeof(uint64_t));
+	gpu->cost = calloc(FAKEGL_MAX_JOBS, sizeof(uint64_t));
+	gpu->done = calloc(FAKEGL_MAX_JOBS, sizeof(uint64_t));
+	gpu->present = calloc(FAKEGL_MAX_JOBS, sizeof(uint64_t));
+	if (!gpu->submit || !gpu->cost || !gpu->done || !gpu->present) {
+		fprintf(stderr, "fakegl: out of memory\n");
+		exit(1);
+	}
+
+	/* timeouts are CLOCK_MONOTONIC like everything else */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&gpu->done_cond, &attr);
+	pthread_cond_init(&gpu->submit_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if (pthread_create(&gpu->thread, NULL, fakegl_gpu_thread, gpu)) {
+		fprintf(stderr, "fakegl: can't start GPU thread\n");
+		exit(1);
+	}
+	pthread_detach(gpu->thread);
+}
+
+uint64_t fakegl_job_done(uint64_t job)
+{
+	struct fakegl_gpu_s *gpu = &fakegl_gpu;
+	uint64_t ret = 0;
+
+	pthread_once(&fakegl_once, fakegl_init);
+	pthread_mutex_lock(&gpu->mutex);
+	if (job < gpu->completed && job + FAKEGL_MAX_JOBS >= gpu->completed)
+		ret = gpu->done[job % FAKEGL_MAX_JOBS];
+	pthread_mutex_unlock(&gpu->mutex);
+
+	return ret;
+}
+
+uint64_t fakegl_job_present(uint64_t job)
+{
+	struct fakegl_gpu_s *gpu = &fakegl_gpu;
+	uint64_t ret = 0;
+
+	pthread_once(&fakegl_once, fakegl_init);
+	pthread_mutex_lock(&gpu->mutex);
+	if (job < gpu->completed && job + FAKEGL_MAX_JOBS >= gpu->completed)
+		ret = gpu->present[job % FAKEGL_MAX_JOBS];
+	pthread_mutex_unlock(&gpu->mutex);
+
+	return ret;
+}
+
+void glClear(GLbitfield mask)
+{
+	struct fakegl_gpu_s *gpu = &fakegl_gpu;
+	uint64_t job, cost;
+
+	pthread_once(&fakegl_once, fakegl_init);
+	pthread_mutex_lock(&gpu->mutex);
+
+	/* don't overwrite results nobody has seen yet */
+	while (gpu->submitted - gpu->completed >= FAKEGL_MAX_JOBS)
+		pthread_cond_wait(&gpu->done_cond, &gpu->mutex);
+
+	cost = gpu->gpu_ns;
+	if (gpu->jitter_ns)
+		cost = cost - gpu->jitter_ns + fakegl_random(gpu) % (2 * gpu->jitter_ns + 1);
+
+	job = gpu->submitted % FAKEGL_MAX_JOBS;
+	gpu->submit[job] = fakegl_now();
+	gpu->cost[job] = cost;
+	gpu->done[job] = 0;
+	gpu->submitted++;
+	pthread_cond_signal(&gpu->submit_cond);
+
+	pthread_mutex_unlock(&gpu->mutex);
+}
+
+void glFlush(void)
+{
+}
+
+void glFinish(void)
+{
+	struct fakegl_gpu_s *gpu = &fakegl_gpu;
+
+	pthread_once(&fakegl_once, fakegl_init);
+	pthread_mutex_lock(&gpu->mutex);
+	while (gpu->completed < gpu->submitted)
+		pthread_cond_wait(&gpu->done_cond, &gpu->mutex);
+	pthread_mutex_unlock(&gpu->mutex);
+}
+
+/* nothing fails here, older glsync builds still ask after every call */
+GLenum glGetError(void)
+{
+	return GL_NO_ERROR;
+}
+
+GLsync glFenceSync(GLenum condition, GLbitfield flags)
+{
+	struct fakegl_sync_s *sync;
+
+	pthread_once(&fakegl_once, fakegl_init);
+	sync = malloc(sizeof(struct fakegl_sync_s));
+	if (!sync)
+		return NULL;
+
+	pthread_mutex_lock(&fakegl_gpu.mutex);
+	sync->value = fakegl_gpu.submitted;
+	pthread_mutex_unlock(&fakegl_gpu.mutex);
+
+	return (GLsync) sync;
+}
+
+GLenum glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	struct fakegl_gpu_s *gpu = &fakegl_gpu;
+	struct fakegl_sync_s *fence = (struct fakegl_sync_s *) sync;
+	uint64_t deadline, now;
+	GLenum ret;
+
+	if (!fence)
+		return GL_WAIT_FAILED;
+
+	now = fakegl_now();
+	deadline = timeout == GL_TIMEOUT_IGNORED || timeout > UINT64_MAX - now ? UINT64_MAX : now + timeout;
+
+	pthread_mutex_lock(&gpu->mutex);
+	if (gpu->completed >= fence->value) {
+		ret = GL_ALREADY_SIGNALED;
+	} else {
+		while (gpu->completed < fence->value && (deadline == UINT64_MAX || fakegl_now() < deadline))
+			fakegl_cond_wait(&gpu->done_cond, &gpu->mutex, deadline);
+		ret = gpu->completed >= fence->value ? GL_CONDITION_SATISFIED : GL_TIMEOUT_EXPIRED;
+	}
+	pthread_mutex_unlock(&gpu->mutex);
+
+	return ret;
+}
+
+void glDeleteSync(GLsync sync)
+{
+	free(sync);
+}
+
+void glGenQueries(GLsizei n, GLuint *ids)
+{
+	struct fakegl_gpu_s *gpu = &fakegl_gpu;
+	GLsizei i;
+
+	pthread_mutex_lock(&gpu->mutex);
+	for (i = 0; i < n; i++) {
+		ids[i] = gpu->next_query % FAKEGL_MAX_QUERIES + 1;
+		gpu->query[ids[i] - 1].used = 0;
+		gpu->next_query++;
+	}
+	pthread_mutex_unlock(&gpu->mutex);
+}
+
+void glDeleteQueries(GLsizei n, const GLuint *ids)
+{
+}
+
+void glQueryCounter(GLuint id, GLenum target)
+{
+	struct fakegl_gpu_s *gpu = &fakegl_gpu;
+	struct fakegl_query_s *q;
+
+	if (id == 0 || id > FAKEGL_MAX_QUERIES || target != GL_TIMESTAMP)
+		return;
+
+	pthread_once(&fakegl_once, fakegl_init);
+	q = &gpu->query[id - 1];
+	pthread_mutex_lock(&gpu->mutex);
+	q->value = gpu->submitted;
+	q->issued = fakegl_now();
+	q->used = 1;
+	pthread_mutex_unlock(&gpu->mutex);
+}
+
+/**
+ * \brief GPU time at which query was reached, caller holds mutex
+ */
+static uint64_t fakegl_query_time(struct fakegl_gpu_s *gpu, struct fakegl_query_s *q)
+{
+	uint64_t done;
+
+	if (q->value == 0)
+		return q->issued;
+
+	done = gpu->done[(q->value - 1) % FAKEGL_MAX_JOBS];
+	return done > q->issued ? done : q->issued;
+}
+
+void glGetQueryObjectiv(GLuint id, GLenum pname, GLint *params)
+{
+	struct fakegl_gpu_s *gpu = &fakegl_gpu;
+	struct fakegl_query_s *q;
+
+	*params = 0;
+	if (id == 0 || id > FAKEGL_MAX_QUERIES || pname != GL_QUERY_RESULT_AVAILABLE)
+		return;
+
+	q = &gpu->query[id - 1];
+	pthread_mutex_lock(&gpu->mutex);
+	*params = q->used && gpu->completed >= q->value;
+	pthread_mutex_unlock(&gpu->mutex);
+}
+
+void glGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64 *params)
+{
+	struct fakegl_gpu_s *gpu = &fakegl_gpu;
+	struct fakegl_query_s *q;
+
+	*params = 0;
+	if (id == 0 || id > FAKEGL_MAX_QUERIES || pname != GL_QUERY_RESULT)
+		return;
+
+	q = &gpu->query[id - 1];
+	pthread_mutex_lock(&gpu->mutex);
+	if (q->used) {
+		while (gpu->completed < q->value)
+			pthread_cond_wait(&gpu->done_cond, &gpu->mutex);
+		*params = fakegl_query_time(gpu, q);
+	}
+	pthread_mutex_unlock(&gpu->mutex);
+}
+
+GLXContext glXCreateContext(Display *dpy, XVisualInfo *vis, GLXContext share, Bool direct)
+{
+	/* only compared, never looked into */
+	return (GLXContext) calloc(1, 64);
+}
+
+void glXDestroyContext(Display *dpy, GLXContext ctx)
+{
+	if (fakegl_current == ctx)
+		fakegl_current = NULL;
+	free(ctx);
+}
+
+Bool glXMakeCurrent(Display *dpy, GLXDrawable drawable, GLXContext ctx)
+{
+	fakegl_current = ctx;
+	return True;
+}
+
+Bool glXMakeContextCurrent(Display *dpy, GLXDrawable draw, GLXDrawable read, GLXContext ctx)
+{
+	fakegl_current = ctx;
+	return True;
+}
+
+GLXContext glXGetCurrentContext(void)
+{
+	return fakegl_current;
+}
+
+/*
+ Enough of the GLX 1.3 config and pbuffer API for glsync to create the
+ hidden context of GLSYNC_WAIT=async. Every context reports config 1.
+ */
+
+int glXQueryContext(Display *dpy, GLXContext ctx, int attribute, int *value)
+{
+	*value = attribute == GLX_FBCONFIG_ID ? 1 : 0;
+	return Success;
+}
+
+GLXFBConfig *glXChooseFBConfig(Display *dpy, int screen, const int *attrib_list, int *nelements)
+{
+	GLXFBConfig *configs = malloc(sizeof(GLXFBConfig));
+
+	*nelements = configs ? 1 : 0;
+	if (configs)
+		configs[0] = (GLXFBConfig) &fakegl_gpu;
+	return configs;
+}
+
+GLXContext glXCreateNewContext(Display *dpy, GLXFBConfig config, int render_type,
+			       GLXContext share, Bool direct)
+{
+	return glXCreateContext(dpy, NULL, share, direct);
+}
+
+GLXPbuffer glXCreatePbuffer(Display *dpy, GLXFBConfig config, const int *attrib_list)
+{
+	return 1;
+}
+
+void glXDestroyPbuffer(Display *dpy, GLXPbuffer pbuf)
+{
+}
+
+Bool glXIsDirect(Display *dpy, GLXContext ctx)
+{
+	return True;
+}
+
+void glXSwapBuffers(Display *dpy, GLXDrawable drawable)
+{
+	struct fakegl_gpu_s *gpu = &fakegl_gpu;
+
+	pthread_once(&fakegl_once, fakegl_init);
+
+	/* driver throttling, wait until at most queue frames are not shown yet */
+	pthread_mutex_lock(&gpu->mutex);
+	while (gpu->submitted > gpu->queue) {
+		uint64_t job = gpu->submitted - gpu->queue - 1;
+		uint64_t present;
+
+		if (job >= gpu->completed) {
+			pthread_cond_wait(&gpu->done_cond, &gpu->mutex);
+			continue;
+		}
+
+		present = gpu->present[job % FAKEGL_MAX_JOBS];
+		if (present <= fakegl_now())
+			break;
+		fakegl_cond_wait(&gpu->done_cond, &gpu->mutex, present);
+	}
+	pthread_mutex_unlock(&gpu->mutex);
+}
+
+Bool glXGetSyncValuesOML(Display *dpy, GLXDrawable drawable, int64_t *ust, int64_t *msc, int64_t *sbc)
+{
+	struct fakegl_gpu_s *gpu = &fakegl_gpu;
+	uint64_t vblanks, now;
+
+	pthread_once(&fakegl_once, fakegl_init);
+	if (!gpu->oml)
+		return False;
+
+	pthread_mutex_lock(&gpu->mutex);
+	now = fakegl_now();
+	vblanks = (now - gpu->vblank_base) / gpu->refresh_ns;
+	*ust = (gpu->vblank_base + vblanks * gpu->refresh_ns) / 1000;
+	*msc = vblanks;
+
+	/* completed swaps as drivers count them, that is frames shown */
+	if (gpu->completed - gpu->shown > FAKEGL_MAX_JOBS)
+		gpu->shown = gpu->completed - FAKEGL_MAX_JOBS;
+	while (gpu->shown < gpu->completed && gpu->present[gpu->shown % FAKEGL_MAX_JOBS] <= now)
+		gpu->shown++;
+	*sbc = gpu->shown;
+	pthread_mutex_unlock(&gpu->mutex);
+
+	return True;
+}
+
+Bool glXGetMscRateOML(Display *dpy, GLXDrawable drawable, int32_t *numerator, int32_t *denominator)
+{
+	pthread_once(&fakegl_once, fakegl_init);
+	if (!fakegl_gpu.oml)
+		return False;
+
+	*numerator = 1000000000;
+	*denominator = fakegl_gpu.refresh_ns;
+	return True;
+}
+
+static void fakegl_set_interval(int interval)
+{
+	pthread_once(&fakegl_once, fakegl_init);
+	pthread_mutex_lock(&fakegl_gpu.mutex);
+	fakegl_gpu.interval = interval;
+	pthread_mutex_unlock(&fakegl_gpu.mutex);
+}
+
+void glXSwapIntervalEXT(Display *dpy, GLXDrawable drawable, int interval)
+{
+	fakegl_set_interval(interval);
+}
+
+int glXSwapIntervalMESA(unsigned int interval)
+{
+	fakegl_set_interval(interval);
+	return 0;
+}
+
+int glXSwapIntervalSGI(int interval)
+{
+	if (interval <= 0)
+		return GLX_BAD_VALUE;
+	fakegl_set_interval(interval);
+	return 0;
+}
+
+/**
+ * \brief name to function table for glXGetProcAddress()
+ */
+static const struct {
+	const char *name;
+	void (*func)(void);
+} fakegl_procs[] = {
+	{ "glClear", (void (*)(void)) glClear },
+	{ "glFlush", (void (*)(void)) glFlush },
+	{ "glFinish", (void (*)(void)) glFinish },
+	{ "glGetError", (void (*)(void)) glGetError },
+	{ "glFenceSync", (void (*)(void)) glFenceSync },
+	{ "glClientWaitSync", (void (*)(void)) glClientWaitSync },
+	{ "glDeleteSync", (void (*)(void)) glDeleteSync },
+	{ "glGenQueries", (void (*)(void)) glGenQueries },
+	{ "glDeleteQueries", (void (*)(void)) glDeleteQueries },
+	{ "glQueryCounter", (void (*)(void)) glQueryCounter },
+	{ "glGetQueryObjectiv", (void (*)(void)) glGetQueryObjectiv },
+	{ "glGetQueryObjectui64v", (void (*)(void)) glGetQueryObjectui64v },
+	{ "glXCreateContext", (void (*)(void)) glXCreateContext },
+	{ "glXDestroyContext", (void (*)(void)) glXDestroyContext },
+	{ "glXMakeCurrent", (void (*)(void)) glXMakeCurrent },
+	{ "glXMakeContextCurrent", (void (*)(void)) glXMakeContextCurrent },
+	{ "glXGetCurrentContext", (void (*)(void)) glXGetCurrentContext },
+	{ "glXQueryContext", (void (*)(void)) glXQueryContext },
+	{ "glXChooseFBConfig", (void (*)(void)) glXChooseFBConfig },
+	{ "glXCreateNewContext", (void (*)(void)) glXCreateNewContext },
+	{ "glXCreatePbuffer", (void (*)(void)) glXCreatePbuffer },
+	{ "glXDestroyPbuffer", (void (*)(void)) glXDestroyPbuffer },
+	{ "glXIsDirect", (void (*)(void)) glXIsDirect },
+	{ "glXSwapBuffers", (void (*)(void)) glXSwapBuffers },
+	{ "glXSwapIntervalEXT", (void (*)(void)) glXSwapIntervalEXT },
+	{ "glXSwapIntervalMESA", (void (*)(void)) glXSwapIntervalMESA },
+	{ "glXSwapIntervalSGI", (void (*)(void)) glXSwapIntervalSGI },
+	{ "glXGetSyncValuesOML", (void (*)(void)) glXGetSyncValuesOML },
+	{ "glXGetMscRateOML", (void (*)(void)) glXGetMscRateOML }
+};
+
+__GLXextFuncPtr glXGetProcAddressARB(const GLubyte *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(fakegl_procs) / sizeof(fakegl_procs[0]); i++) {
+		if (!strcmp(fakegl_procs[i].name, (const char *) name))
+			return fakegl_procs[i].func;
+	}
+
+	return NULL;
+}
+
+void (*glXGetProcAddress(const GLubyte *name))(void)
+{
+	return glXGetProcAddressARB(name);
+}
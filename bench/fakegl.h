@@ -0,0 +1,56 @@
+/**
+ * \file bench/fakegl.h
+ * \brief stand-in libGL.so.1 with a simulated GPU queue
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+#ifndef FAKEGL_H
+#define FAKEGL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  \defgroup fakegl fakegl
+ *  Implements just enough GLX and GL for glsync. Every glClear() submits
+ *  one job to a GPU thread that executes jobs in order, each taking
+ *  FAKEGL_GPU_US +- FAKEGL_JITTER_US microseconds (uniform, seeded with
+ *  FAKEGL_SEED). Fences and timestamp queries signal as the GPU thread
+ *  reaches them. A display refreshing at FAKEGL_REFRESH_HZ shows each
+ *  job as a frame, on the first vblank allowed by the swap interval, and
+ *  reports its vblanks through GLX_OML_sync_control. glXSwapBuffers()
+ *  blocks while more than FAKEGL_QUEUE frames are not shown yet, like
+ *  drivers throttle applications that run ahead.
+ *  \{
+ */
+
+/** completion times kept, jobs are indexed modulo this */
+#define FAKEGL_MAX_JOBS 65536
+
+/**
+ * \brief returns when given job finished on the fake GPU
+ * \param job job index, counting glClear() calls from 0
+ * \return CLOCK_MONOTONIC time in ns, 0 if job has not finished
+ */
+uint64_t fakegl_job_done(uint64_t job);
+
+/**
+ * \brief returns when given job was shown on the fake display
+ * \param job job index, counting glClear() calls from 0
+ * \return CLOCK_MONOTONIC time in ns, completion time with swap interval
+ *         0, 0 if job has not finished
+ */
+uint64_t fakegl_job_present(uint64_t job);
+
+/** \} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+/**
+ * \file bench/gensyms.c
+ * \brief writes C source of a library with many exported symbols
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+/*
+ Use:
+ gensyms <count> <output.c>
+
+ Symbols are data, bench_sym_000000 ... so that big libraries build fast.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv)
+{
+	unsigned int count, i;
+	FILE *out;
+
+	if (argc < 3 || (count = atoi(argv[1])) == 0) {
+		fprintf(stderr, "usage: %s <count> <output.c>\n", argv[0]);
+		return 1;
+	}
+
+	out = fopen(argv[2], "w");
+	if (!out) {
+		perror(argv[2]);
+		return 1;
+	}
+
+	for (i = 0; i < count; i++)
+		fprintf(out, "int bench_sym_%06u = %u;\n", i, i);
+
+	return fclose(out) ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+/**
+ * \file bench/pacing-bench.c
+ * \brief renders frames on the fake GPU and reports pacing results
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+/*
+ Use:
+ [GLSYNC_*=...] LD_PRELOAD=libglsync.so bench/pacing-bench <label> [frames] [cpu us]
+
+ Linked against the fake libGL.so.1 from bench/fakegl, see fakegl.c for
+ its FAKEGL_* settings. bench/pacing-bench.sh runs the usual set of
+ configurations.
+
+ Every frame spins for cpu us, as if the application was building it,
+ submits it with glClear() and swaps. Printed as one JSON line:
+  fps       - frames per second over the whole run
+  swap_us   - time spent in glXSwapBuffers(), that is glsync's waits plus
+              the fake driver's throttling
+  latency_ms - from frame start to its completion on the fake GPU, what
+              glsync tries to keep low
+  present_ms - from frame start to when the fake display showed it
+  stutter   - frames shown more than half a median frame time later than
+              the median frame time after the previous one
+  in_flight - glsync_frames_submitted() - glsync_frames_completed() at each
+              swap, mean, -1 without glsync
+
+ With PACING_MAX_STUTTER set the result is still printed, but the exit
+ status is 2 when more frames than that stuttered.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <GL/gl.h>
+#include <GL/glx.h>
+#include "fakegl.h"
+#include "glsync.h"
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * \brief sorts values and returns given percentile
+ */
+static uint64_t percentile(uint64_t *val, unsigned int count, unsigned int pct)
+{
+	qsort(val, count, sizeof(uint64_t), cmp_u64);
+	return val[(count - 1) * pct / 100];
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int frames = argc > 2 ? atoi(argv[2]) : 2000;
+	uint64_t cpu_ns = (argc > 3 ? atoi(argv[3]) : 2000) * 1000ull;
+	uint64_t *start, *swap, *latency, *present, *gap, t, begin, end, swap_total = 0;
+	uint64_t gap_p50, stutter = 0;
+	const char *max_stutter = getenv("PACING_MAX_STUTTER");
+	uint64_t (*submitted)(void), (*completed)(void), in_flight = 0;
+	GLXContext ctx;
+	unsigned int i;
+
+	if (argc < 2 || frames < 2 || frames > FAKEGL_MAX_JOBS) {
+		fprintf(stderr, "usage: %s <label> [frames, 2 to %u] [cpu us]\n",
+			argv[0], FAKEGL_MAX_JOBS);
+		return 1;
+	}
+
+	start = calloc(frames, sizeof(uint64_t));
+	swap = calloc(frames, sizeof(uint64_t));
+	latency = calloc(frames, sizeof(uint64_t));
+	present = calloc(frames, sizeof(uint64_t));
+	gap = calloc(frames, sizeof(uint64_t));
+	if (!start || !swap || !latency || !present || !gap)
+		return 1;
+
+	submitted = (uint64_t (*)(void)) dlsym(RTLD_DEFAULT, "glsync_frames_submitted");
+	completed = (uint64_t (*)(void)) dlsym(RTLD_DEFAULT, "glsync_frames_completed");
+
+	/* the fake driver never looks at the display */
+	ctx = glXCreateContext(NULL, NULL, NULL, True);
+	glXMakeCurrent(NULL, 1, ctx);
+
+	begin = now();
+	for (i = 0; i < frames; i++) {
+		start[i] = now();
+		while (now() - start[i] < cpu_ns)
+			;
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		t = now();
+		glXSwapBuffers(NULL, 1);
+		swap[i] = now() - t;
+		swap_total += swap[i];
+
+		if (submitted && completed)
+			in_flight += submitted() - completed();
+	}
+	glFinish();
+	end = now();
+
+	for (i = 0; i < frames; i++) {
+		latency[i] = fakegl_job_done(i) - start[i];
+		present[i] = fakegl_job_present(i);
+		gap[i] = i ? present[i] - present[i - 1] : 0;
+	}
+
+	gap_p50 = percentile(gap + 1, frames - 1, 50);
+	for (i = 1; i < frames; i++) {
+		if (present[i] - present[i - 1] > gap_p50 + gap_p50 / 2)
+			stutter++;
+		present[i - 1] -= start[i - 1];
+	}
+	present[frames - 1] -= start[frames - 1];
+
+	printf("{\"config\": \"%s\", \"frames\": %u, \"fps\": %.1f, "
+	       "\"swap_us_mean\": %.1f, \"swap_us_p50\": %.1f, \"swap_us_p99\": %.1f, "
+	       "\"latency_ms_p50\": %.2f, \"latency_ms_p99\": %.2f, "
+	       "\"present_ms_p50\": %.2f, \"present_ms_p99\": %.2f, \"stutter\": %llu, \"in_flight\": %.2f}\n",
+	       argv[1], frames, frames * 1e9 / (end - begin),
+	       swap_total / 1e3 / frames,
+	       percentile(swap, frames, 50) / 1e3, percentile(swap, frames, 99) / 1e3,
+	       percentile(latency, frames, 50) / 1e6, percentile(latency, frames, 99) / 1e6,
+	       percentile(present, frames, 50) / 1e6, percentile(present, frames, 99) / 1e6,
+	       (unsigned long long) stutter,
+	       submitted && completed ? (double) in_flight / frames : -1.0);
+
+	glXMakeCurrent(NULL, None, NULL);
+	glXDestroyContext(NULL, ctx);
+
+	if (max_stutter && stutter > strtoull(max_stutter, NULL, 10)) {
+		fprintf(stderr, "%s: %llu frames stuttered, at most %s allowed\n",
+			argv[1], (unsigned long long) stutter, max_stutter);
+		return 2;
+	}
+
+	return 0;
+}
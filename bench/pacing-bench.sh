@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# Runs pacing-bench on the fake GPU under a set of glsync configurations.
+#
+# Use:
+# bench/pacing-bench.sh <build dir> [frames] > results.jsonl
+#
+# FAKEGL_* settings in the environment are passed through, defaults give
+# a GPU bound application: 2 ms of CPU and 4 +- 1 ms of GPU per frame.
+# The "overhead" runs use a free GPU so that only the swap hook is timed,
+# the "cpu-bound" runs a GPU that keeps up, 1 +- 0.5 ms per frame, and the
+# "vsync" runs show frames on a 60 Hz display with swap interval 1.
+#
+# The "check" runs must not stutter more than PACING_MAX_STUTTER times
+# (default 0), the script exits with 2 after all runs if one did. Give it
+# some slack on machines that can't wake a thread within a millisecond.
+
+BUILD=${1:?usage: $0 <build dir> [frames]}
+FRAMES=${2:-2000}
+BENCH="$BUILD/bench/pacing-bench"
+GLSYNC="$BUILD/sync/libglsync.so"
+
+: ${FAKEGL_GPU_US:=4000}
+: ${FAKEGL_JITTER_US:=1000}
+: ${FAKEGL_SEED:=1}
+export FAKEGL_GPU_US FAKEGL_JITTER_US FAKEGL_SEED
+: ${PACING_MAX_STUTTER:=0}
+failed=0
+
+# <label> [VAR=value ...], labels ending in "none" run without glsync
+run() {
+	label=$1
+	shift
+	if [ "${label%none}" != "$label" ]; then
+		env "$@" "$BENCH" "$label" "$FRAMES" || exit 1
+	else
+		env "$@" LD_PRELOAD="$GLSYNC" "$BENCH" "$label" "$FRAMES" 2>/dev/null || exit 1
+	fi
+}
+
+# like run, but with glsync and counted as failed when it stutters too often
+check() {
+	label=$1
+	shift
+	if ! env "$@" PACING_MAX_STUTTER="$PACING_MAX_STUTTER" LD_PRELOAD="$GLSYNC" \
+		"$BENCH" "$label" "$FRAMES" 2>/dev/null; then
+		echo "$0: $label stuttered more than $PACING_MAX_STUTTER times" >&2
+		failed=2
+	fi
+}
+
+run none
+run fence-d0 GLSYNC_DEPTH=0
+run fence-d1 GLSYNC_DEPTH=1
+run fence-d2 GLSYNC_DEPTH=2
+run fence-d1-poll GLSYNC_DEPTH=1 GLSYNC_WAIT=poll
+run fence-d1-hybrid GLSYNC_DEPTH=1 GLSYNC_WAIT=hybrid
+run fence-d1-async GLSYNC_DEPTH=1 GLSYNC_WAIT=async
+run fence-d1-fps120 GLSYNC_DEPTH=1 GLSYNC_FPS=120
+run fence-auto GLSYNC_DEPTH=auto
+run fence-auto-latency5ms GLSYNC_DEPTH=auto GLSYNC_LATENCY_US=5000
+run cpu-bound-d0 FAKEGL_GPU_US=1000 FAKEGL_JITTER_US=500 GLSYNC_DEPTH=0
+run cpu-bound-d1 FAKEGL_GPU_US=1000 FAKEGL_JITTER_US=500 GLSYNC_DEPTH=1
+run cpu-bound-auto FAKEGL_GPU_US=1000 FAKEGL_JITTER_US=500 GLSYNC_DEPTH=auto
+run jit-fps120 GLSYNC_MODE=jit GLSYNC_FPS=120
+run overhead-none FAKEGL_GPU_US=0 FAKEGL_JITTER_US=0
+run overhead-fence FAKEGL_GPU_US=0 FAKEGL_JITTER_US=0
+run overhead-async FAKEGL_GPU_US=0 FAKEGL_JITTER_US=0 GLSYNC_WAIT=async
+run vsync-none FAKEGL_SWAP_INTERVAL=1
+run vsync-fence-d1 FAKEGL_SWAP_INTERVAL=1 GLSYNC_DEPTH=1
+run vsync-jit-fps60 FAKEGL_SWAP_INTERVAL=1 GLSYNC_MODE=jit GLSYNC_FPS=60
+run vsync-vblank FAKEGL_SWAP_INTERVAL=1 GLSYNC_MODE=vblank
+run vsync-vblank-no-oml FAKEGL_SWAP_INTERVAL=1 GLSYNC_MODE=vblank FAKEGL_OML=0
+run vsync-vblank-interval2 FAKEGL_SWAP_INTERVAL=1 GLSYNC_MODE=vblank GLSYNC_SWAP_INTERVAL=2
+check check-vsync-vblank-jitter1ms FAKEGL_SWAP_INTERVAL=1 GLSYNC_MODE=vblank FAKEGL_JITTER_US=1000
+check check-vsync-jit-fps60-jitter1ms FAKEGL_SWAP_INTERVAL=1 GLSYNC_MODE=jit GLSYNC_FPS=60 FAKEGL_JITTER_US=1000
+
+exit $failed
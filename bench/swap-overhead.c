@@ -0,0 +1,90 @@
+/**
+ * \file bench/swap-overhead.c
+ * \brief times glXSwapBuffers() with the GPU idle, to see what a hook adds
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+/*
+ Use:
+ [LD_PRELOAD=libglsync.so] bench/swap-overhead <label> [frames]
+
+ Linked against the fake libGL.so.1 from bench/fakegl, run with
+ FAKEGL_GPU_US=0 so that the GPU never holds a swap up. Every frame is
+ cleared and finished before its swap is timed, so only the CPU side of
+ whatever sits in front of the driver's glXSwapBuffers() is measured.
+ Prints label, mean, median and 99th percentile of one swap in ns.
+
+ bench/swap-overhead.sh runs it without glsync, with a baseline build and
+ with the current one and reports what each adds per swap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <GL/gl.h>
+#include <GL/glx.h>
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int frames = argc > 2 ? atoi(argv[2]) : 20000;
+	uint64_t *sample, t, total = 0;
+	GLXContext ctx;
+	unsigned int i;
+
+	if (argc < 2 || frames == 0) {
+		fprintf(stderr, "usage: %s <label> [frames]\n", argv[0]);
+		return 1;
+	}
+
+	sample = calloc(frames, sizeof(uint64_t));
+	if (!sample)
+		return 1;
+
+	/* the fake driver never looks at the display */
+	ctx = glXCreateContext(NULL, NULL, NULL, True);
+	glXMakeCurrent(NULL, 1, ctx);
+
+	/* hooks set themselves up on the first swap, that one is not counted */
+	glClear(GL_COLOR_BUFFER_BIT);
+	glXSwapBuffers(NULL, 1);
+
+	for (i = 0; i < frames; i++) {
+		glClear(GL_COLOR_BUFFER_BIT);
+		glFinish();
+
+		t = now();
+		glXSwapBuffers(NULL, 1);
+		sample[i] = now() - t;
+		total += sample[i];
+	}
+	glFinish();
+
+	glXMakeCurrent(NULL, None, NULL);
+	glXDestroyContext(NULL, ctx);
+
+	qsort(sample, frames, sizeof(uint64_t), cmp_u64);
+	printf("%-10s %12llu %12llu %12llu\n", argv[1],
+	       (unsigned long long) (total / frames),
+	       (unsigned long long) sample[frames / 2],
+	       (unsigned long long) sample[(frames - 1) * 99 / 100]);
+
+	return 0;
+}
@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# Times the swap hook of a baseline glsync build and of the current one
+# against no hook at all, on the fake GPU with nothing to render.
+#
+# Use:
+# bench/swap-overhead.sh <build dir> <baseline libglsync.so> [frames]
+#
+# A baseline comes from building an older revision, for example:
+# git worktree add /tmp/glsync-base <rev>
+# cmake -S /tmp/glsync-base -B /tmp/glsync-base/build
+# cmake --build /tmp/glsync-base/build --target glsync
+# bench/swap-overhead.sh build /tmp/glsync-base/build/sync/libglsync.so
+#
+# GLSYNC_* settings in the environment apply to both builds. The "+ns"
+# column is the mean added per swap over the run without a hook.
+
+BUILD=${1:?usage: $0 <build dir> <baseline libglsync.so> [frames]}
+BASELINE=${2:?usage: $0 <build dir> <baseline libglsync.so> [frames]}
+FRAMES=${3:-20000}
+BENCH="$BUILD/bench/swap-overhead"
+GLSYNC="$BUILD/sync/libglsync.so"
+
+FAKEGL_GPU_US=0
+FAKEGL_JITTER_US=0
+export FAKEGL_GPU_US FAKEGL_JITTER_US
+
+{
+	"$BENCH" none "$FRAMES" || exit 1
+	LD_PRELOAD="$BASELINE" "$BENCH" baseline "$FRAMES" 2>/dev/null || exit 1
+	LD_PRELOAD="$GLSYNC" "$BENCH" current "$FRAMES" 2>/dev/null || exit 1
+} | awk '
+	BEGIN { printf "%-10s %12s %12s %12s %12s\n", "build", "mean ns", "p50 ns", "p99 ns", "+ns" }
+	NR == 1 { none = $2 }
+	{ printf "%-10s %12d %12d %12d %12d\n", $1, $2, $3, $4, $2 - none }
+'
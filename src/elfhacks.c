@@ -15,6 +15,10 @@
 #include <elf.h>
 #include <link.h>
 #include <fnmatch.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stddef.h>
 #include "elfhacks.h"
 
 /**
@@ -22,13 +26,71 @@
  *  \{
  */
 
-struct eh_iterate_callback_args {
-	eh_iterate_obj_callback_func callback;
-	void *arg;
+/**
+ * \brief loaded object as seen by the registry
+ */
+struct eh_registry_obj {
+	/** parsed object, index is always NULL */
+	eh_obj_t obj;
+	/** copy of dlpi_name, obj.name points here */
+	char *name;
+	/** eh_init_obj() result */
+	int ret;
+	/** eh_hash_gnu() of soname stem */
+	Elf32_Word stem_hash;
+};
+
+/**
+ * \brief process-wide list of loaded objects
+ *
+ * Rebuilt only when dlpi_adds or dlpi_subs change, objects that are
+ * still loaded keep their parsed dynamic section.
+ */
+struct eh_registry {
+	pthread_mutex_t mutex;
+	/** dlpi_adds and dlpi_subs at last rebuild */
+	unsigned long long adds, subs;
+	/** counters are valid */
+	int counted;
+	/** objects in dl_iterate_phdr() order */
+	struct eh_registry_obj *obj;
+	unsigned int nobj, size;
+	/** soname stem index, entry number + 1, 0 marks empty slots */
+	unsigned int *index;
+	unsigned int index_mask;
+};
+
+/**
+ * \brief eh_registry_update() pass state
+ */
+struct eh_registry_args {
+	struct eh_registry *reg;
+	/** previous list, reused entries get their name cleared */
+	struct eh_registry_obj *old;
+	unsigned int nold, cursor;
+	int ret;
+};
+
+static struct eh_registry eh_registry = { PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * \brief parsed DT_GNU_HASH header
+ */
+struct eh_gnu_hash_table {
+	Elf32_Word nbuckets, symbias, bitmask_nwords, bitmask_idxbits, shift;
+	ElfW(Addr) *bitmask;
+	Elf32_Word *buckets, *chain_zero;
 };
 
 int eh_check_addr(eh_obj_t *obj, const void *addr);
-int eh_find_callback(struct dl_phdr_info *info, size_t size, void *argptr);
+int eh_registry_counters_callback(struct dl_phdr_info *info, size_t size, void *argptr);
+int eh_registry_callback(struct dl_phdr_info *info, size_t size, void *argptr);
+int eh_registry_update(struct eh_registry *reg);
+int eh_registry_index(struct eh_registry *reg);
+int eh_registry_find(struct eh_registry *reg, const char *soname);
+int eh_registry_match(struct eh_registry_obj *entry, const char *soname, int plain);
+size_t eh_soname_stem(const char *name, size_t len, const char **stem);
+Elf32_Word eh_hash_gnu_len(const char *name, size_t len);
 int eh_find_next_dyn(eh_obj_t *obj, ElfW_Sword tag, int i, ElfW(Dyn) **next);
 int eh_init_obj(eh_obj_t *obj);
 
@@ -36,91 +98,335 @@ int eh_set_rela_plt(eh_obj_t *obj, int p, const char *sym, void *val);
 int eh_set_rel_plt(eh_obj_t *obj, int p, const char *sym, void *val);
 
 int eh_iterate_rela_plt(eh_obj_t *obj, int p, eh_iterate_rel_callback_func callback, void *arg);
+
+/**
+ * \brief writable window for eh_set_rels()
+ */
+struct eh_rels_args {
+	eh_rel_set_t *set;
+	/** page aligned PT_GNU_RELRO range, empty if none */
+	ElfW(Addr) relro_start, relro_end;
+};
+
+int eh_rel_set_find(eh_rel_set_t *set, const char *name);
+int eh_set_rels_slot(eh_obj_t *obj, struct eh_rels_args *args, ElfW(Word) symidx, ElfW(Addr) offset);
+int eh_set_rels_rela(eh_obj_t *obj, struct eh_rels_args *args, ElfW(Rela) *rela, size_t n, int plt);
+int eh_set_rels_rel(eh_obj_t *obj, struct eh_rels_args *args, ElfW(Rel) *rel, size_t n, int plt);
 int eh_iterate_rel_plt(eh_obj_t *obj, int p, eh_iterate_rel_callback_func callback, void *arg);
 
-int eh_find_sym_hash(eh_obj_t *obj, const char *name, eh_sym_t *sym);
-int eh_find_sym_gnu_hash(eh_obj_t *obj, const char *name, eh_sym_t *sym);
+int eh_find_sym_hash(eh_obj_t *obj, eh_symref_t *ref, eh_sym_t *sym);
+int eh_find_sym_gnu_hash(eh_obj_t *obj, eh_symref_t *ref, eh_sym_t *sym);
+int eh_find_sym_index(eh_obj_t *obj, eh_symref_t *ref, eh_sym_t *sym);
+int eh_find_sym_ref(eh_obj_t *obj, struct eh_gnu_hash_table *table, eh_symref_t *ref, eh_sym_t *sym);
+int eh_gnu_hash_parse(eh_obj_t *obj, struct eh_gnu_hash_table *table);
+int eh_gnu_hash_lookup(eh_obj_t *obj, struct eh_gnu_hash_table *table, eh_symref_t *ref, eh_sym_t *sym);
+int eh_match_sym(eh_obj_t *obj, ElfW(Sym) *esym, eh_symref_t *ref);
+
+int eh_count_syms(eh_obj_t *obj);
+int eh_build_index(eh_obj_t *obj);
 
 ElfW(Word) eh_hash_elf(const char *name);
 Elf32_Word eh_hash_gnu(const char *name);
 
-int eh_find_callback(struct dl_phdr_info *info, size_t size, void *argptr)
+/* dlpi_adds and dlpi_subs appeared in glibc 2.4 */
+#define EH_HAS_COUNTERS(size) \
+	((size) >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(((struct dl_phdr_info *) 0)->dlpi_subs))
+
+int eh_registry_counters_callback(struct dl_phdr_info *info, size_t size, void *argptr)
 {
-	eh_obj_t *find = (eh_obj_t *) argptr;
+	struct eh_registry *reg = argptr;
 
-	if (find->name == NULL) {
-		if (strcmp(info->dlpi_name, ""))
-			return 0;
-	} else if (fnmatch(find->name, info->dlpi_name, 0))
-		return 0;
+	/* counters are the same in every entry, first one is enough */
+	if (!EH_HAS_COUNTERS(size) || !reg->counted)
+		return 1;
 
-	if (find->name == NULL) /* TODO readlink? */
-		find->name = "/proc/self/exe";
-	else
-		find->name = info->dlpi_name;
-	find->addr = info->dlpi_addr;
+	if (info->dlpi_adds != reg->adds || info->dlpi_subs != reg->subs)
+		return 1;
 
-	/* segment headers */
-	find->phdr = info->dlpi_phdr;
-	find->phnum = info->dlpi_phnum;
+	return 2;
+}
 
-	return 0;
+size_t eh_soname_stem(const char *name, size_t len, const char **stem)
+{
+	/*
+	 Stem is base name up to and including ".so", so
+	 "/usr/lib/libGL.so.1" and "*libGL.so*" both index as "libGL.so".
+	*/
+	size_t i, base = 0;
+
+	for (i = 0; i < len; i++) {
+		if (name[i] == '/')
+			base = i + 1;
+	}
+	*stem = &name[base];
+
+	for (i = base; i + 3 <= len; i++) {
+		if (!memcmp(&name[i], ".so", 3) && (i + 3 == len || name[i + 3] == '.'))
+			return i + 3 - base;
+	}
+
+	return len - base;
 }
 
-int eh_iterate_callback(struct dl_phdr_info *info, size_t size, void *argptr)
+int eh_registry_callback(struct dl_phdr_info *info, size_t size, void *argptr)
 {
-	struct eh_iterate_callback_args *args = argptr;
-	eh_obj_t obj;
-	int ret = 0;
+	struct eh_registry_args *args = argptr;
+	struct eh_registry *reg = args->reg;
+	struct eh_registry_obj *entry, *tmp;
+	const char *stem;
+	unsigned int i;
+	size_t len;
 
-	/* eh_init_obj needs phdr and phnum */
-	obj.phdr = info->dlpi_phdr;
-	obj.phnum = info->dlpi_phnum;
-	obj.addr = info->dlpi_addr;
-	obj.name = info->dlpi_name;
+	if (reg->nobj == 0 && EH_HAS_COUNTERS(size)) {
+		reg->adds = info->dlpi_adds;
+		reg->subs = info->dlpi_subs;
+		reg->counted = 1;
+	}
 
-	if ((ret = eh_init_obj(&obj))) {
-		if (ret == ENOTSUP) /* just skip */
+	if (reg->nobj == reg->size) {
+		tmp = realloc(reg->obj, (reg->size ? reg->size * 2 : 64) * sizeof(struct eh_registry_obj));
+		if (!tmp) {
+			args->ret = ENOMEM;
+			return 1;
+		}
+		reg->obj = tmp;
+		reg->size = reg->size ? reg->size * 2 : 64;
+	}
+	entry = &reg->obj[reg->nobj];
+
+	/*
+	 dlopen() appends and dlclose() removes, so objects still loaded
+	 come in the same order as last time. Same headers at the same
+	 address under the same name parse the same way.
+	*/
+	for (i = args->cursor; i < args->nold; i++) {
+		if (args->old[i].obj.phdr == info->dlpi_phdr &&
+		    args->old[i].obj.addr == info->dlpi_addr &&
+		    !strcmp(args->old[i].name, info->dlpi_name)) {
+			*entry = args->old[i];
+			args->old[i].name = NULL;
+			args->cursor = i + 1;
+			reg->nobj++;
 			return 0;
-		return ret;
+		}
 	}
 
-	if ((ret = args->callback(&obj, args->arg)))
-		return ret;
+	entry->name = strdup(info->dlpi_name);
+	if (!entry->name) {
+		args->ret = ENOMEM;
+		return 1;
+	}
 
-	if ((ret = eh_destroy_obj(&obj)))
-		return ret;
+	/* eh_init_obj needs phdr and phnum */
+	entry->obj.phdr = info->dlpi_phdr;
+	entry->obj.phnum = info->dlpi_phnum;
+	entry->obj.addr = info->dlpi_addr;
+	entry->obj.name = entry->name;
+	entry->ret = eh_init_obj(&entry->obj);
 
+	len = eh_soname_stem(entry->name, strlen(entry->name), &stem);
+	entry->stem_hash = eh_hash_gnu_len(stem, len);
+
+	reg->nobj++;
 	return 0;
 }
 
-int eh_iterate_obj(eh_iterate_obj_callback_func callback, void *arg)
+int eh_registry_index(struct eh_registry *reg)
 {
-	int ret;
-	struct eh_iterate_callback_args args;
+	unsigned int i, slot, size = 4;
+
+	/* at most half full */
+	while (size < reg->nobj * 2)
+		size <<= 1;
+
+	if (size - 1 != reg->index_mask || !reg->index) {
+		free(reg->index);
+		reg->index = malloc(size * sizeof(unsigned int));
+		if (!reg->index) {
+			reg->counted = 0;
+			return ENOMEM;
+		}
+		reg->index_mask = size - 1;
+	}
+	memset(reg->index, 0, size * sizeof(unsigned int));
 
-	args.callback = callback;
-	args.arg = arg;
+	/* main program has no soname */
+	for (i = 0; i < reg->nobj; i++) {
+		if (reg->obj[i].name[0] == '\0')
+			continue;
 
-	if ((ret = dl_iterate_phdr(eh_iterate_callback, &args)))
-		return ret;
+		slot = reg->obj[i].stem_hash & reg->index_mask;
+		while (reg->index[slot])
+			slot = (slot + 1) & reg->index_mask;
+		reg->index[slot] = i + 1;
+	}
 
 	return 0;
 }
 
-int eh_find_obj(eh_obj_t *obj, const char *soname)
+int eh_registry_update(struct eh_registry *reg)
 {
+	struct eh_registry_args args;
+	unsigned int i;
+
 	/* This function uses glibc-specific dl_iterate_phdr().
 	   Another way could be parsing /proc/self/exe or using
 	   pmap() on Solaris or *BSD */
+	if (dl_iterate_phdr(eh_registry_counters_callback, reg) == 2)
+		return 0;
+
+	args.reg = reg;
+	args.old = reg->obj;
+	args.nold = reg->nobj;
+	args.cursor = 0;
+	args.ret = 0;
+
+	reg->obj = NULL;
+	reg->nobj = reg->size = 0;
+	reg->counted = 0;
+	dl_iterate_phdr(eh_registry_callback, &args);
+
+	for (i = 0; i < args.nold; i++)
+		free(args.old[i].name);
+	free(args.old);
+
+	if (args.ret) {
+		/* keep what we got, try again next time */
+		reg->counted = 0;
+		eh_registry_index(reg);
+		return args.ret;
+	}
+
+	return eh_registry_index(reg);
+}
+
+int eh_registry_match(struct eh_registry_obj *entry, const char *soname, int plain)
+{
+	const char *stem;
+	size_t len;
+
+	if (!fnmatch(soname, entry->name, 0))
+		return 1;
+	if (!plain)
+		return 0;
+
+	/* "libGL.so.1" is the base name, "libGL.so" the stem */
+	len = eh_soname_stem(entry->name, strlen(entry->name), &stem);
+	return !strcmp(stem, soname) || (strlen(soname) == len && !strncmp(stem, soname, len));
+}
+
+int eh_registry_find(struct eh_registry *reg, const char *soname)
+{
+	const char *stem, *p;
+	unsigned int i, slot;
+	size_t len, stem_len;
+	Elf32_Word hash;
+	int plain;
+
+	if (soname == NULL) {
+		for (i = 0; i < reg->nobj; i++) {
+			if (reg->obj[i].name[0] == '\0')
+				return i;
+		}
+		return -1;
+	}
+
+	/*
+	 Plain names match the base name or stem, patterns the full path.
+	 Plain names and "*libfoo.so*" style patterns go through the index,
+	 first indexed object that matches wins. Anything else, or an index
+	 miss, is matched against every object.
+	*/
+	p = soname[0] == '*' ? soname + 1 : soname;
+	len = strcspn(p, "*?[\\");
+	plain = p == soname && p[len] == '\0' && !strchr(soname, '/');
+	if (reg->index && (p[len] == '\0' || (p > soname && !strcmp(&p[len], "*")))) {
+		stem_len = eh_soname_stem(p, len, &stem);
+		if (p == soname || (stem == p && stem_len == len)) {
+			hash = eh_hash_gnu_len(stem, stem_len);
+			for (slot = hash & reg->index_mask; reg->index[slot]; slot = (slot + 1) & reg->index_mask) {
+				i = reg->index[slot] - 1;
+				if (reg->obj[i].stem_hash == hash && eh_registry_match(&reg->obj[i], soname, plain))
+					return i;
+			}
+		}
+	}
+
+	for (i = 0; i < reg->nobj; i++) {
+		if (eh_registry_match(&reg->obj[i], soname, plain))
+			return i;
+	}
+
+	return -1;
+}
+
+int eh_iterate_obj(eh_iterate_obj_callback_func callback, void *arg)
+{
+	eh_obj_t *objs;
+	unsigned int i, n = 0;
+	int ret;
+
+	pthread_mutex_lock(&eh_registry.mutex);
+	if ((ret = eh_registry_update(&eh_registry)) && !eh_registry.obj) {
+		pthread_mutex_unlock(&eh_registry.mutex);
+		return ret;
+	}
+
+	/* callbacks get copies, so they are free to dlopen() or eh_find_obj() */
+	objs = malloc((eh_registry.nobj + 1) * sizeof(eh_obj_t));
+	if (!objs) {
+		pthread_mutex_unlock(&eh_registry.mutex);
+		return ENOMEM;
+	}
+
+	for (i = 0; i < eh_registry.nobj; i++) {
+		if (eh_registry.obj[i].ret == ENOTSUP) /* just skip */
+			continue;
+		objs[n++] = eh_registry.obj[i].obj;
+	}
+	pthread_mutex_unlock(&eh_registry.mutex);
+
+	ret = 0;
+	for (i = 0; i < n; i++) {
+		ret = callback(&objs[i], arg);
+		eh_destroy_obj(&objs[i]);
+		if (ret)
+			break;
+	}
+
+	for (i++; i < n; i++)
+		eh_destroy_obj(&objs[i]);
+	free(objs);
+
+	return ret;
+}
+
+int eh_find_obj(eh_obj_t *obj, const char *soname)
+{
+	int i, ret;
+
 	obj->phdr = NULL;
-	obj->name = soname;
-	dl_iterate_phdr(eh_find_callback, obj);
+	obj->index = NULL;
 
-	if (!obj->phdr)
+	pthread_mutex_lock(&eh_registry.mutex);
+	if ((ret = eh_registry_update(&eh_registry)) && !eh_registry.obj) {
+		pthread_mutex_unlock(&eh_registry.mutex);
+		return ret;
+	}
+
+	if ((i = eh_registry_find(&eh_registry, soname)) < 0) {
+		pthread_mutex_unlock(&eh_registry.mutex);
 		return EAGAIN;
+	}
+
+	*obj = eh_registry.obj[i].obj;
+	ret = eh_registry.obj[i].ret;
+	pthread_mutex_unlock(&eh_registry.mutex);
+
+	if (soname == NULL) /* TODO readlink? */
+		obj->name = "/proc/self/exe";
 
-	return eh_init_obj(obj);
+	return ret;
 }
 
 int eh_check_addr(eh_obj_t *obj, const void *addr)
@@ -152,6 +458,9 @@ int eh_init_obj(eh_obj_t *obj)
 	 as well.
 	*/
 	int p;
+	obj->nsyms = 0;
+	obj->index = NULL;
+	obj->index_mask = 0;
 	obj->dynamic = NULL;
 	for (p = 0; p < obj->phnum; p++) {
 		if (obj->phdr[p].p_type == PT_DYNAMIC) {
@@ -226,29 +535,88 @@ int eh_init_obj(eh_obj_t *obj)
 	return 0;
 }
 
-int eh_find_sym(eh_obj_t *obj, const char *name, void **to)
+void eh_init_symref(eh_symref_t *ref, const char *name)
 {
-	eh_sym_t sym;
+	ref->name = name;
+	ref->len = strlen(name);
+	ref->gnu_hash = eh_hash_gnu(name);
+	ref->elf_hash = 0;
+	ref->flags = EH_SYMREF_GNU;
+}
+
+int eh_match_sym(eh_obj_t *obj, ElfW(Sym) *esym, eh_symref_t *ref)
+{
+	const char *name;
+
+	if (!esym->st_name)
+		return 0;
+
+	name = &obj->strtab[esym->st_name];
+	return !memcmp(name, ref->name, ref->len) && name[ref->len] == '\0';
+}
+
+int eh_find_sym_ref(eh_obj_t *obj, struct eh_gnu_hash_table *table, eh_symref_t *ref, eh_sym_t *sym)
+{
+	/* names too long for EH_SYMREF() get hashed here, once */
+	if (!(ref->flags & EH_SYMREF_GNU)) {
+		ref->gnu_hash = eh_hash_gnu(ref->name);
+		ref->flags |= EH_SYMREF_GNU;
+	}
 
 	/* DT_GNU_HASH is faster ;) */
-	if (obj->gnu_hash) {
-		if (!eh_find_sym_gnu_hash(obj, name, &sym)) {
-			*to = (void *) (sym.sym->st_value + obj->addr);
+	if (table) {
+		if (!eh_gnu_hash_lookup(obj, table, ref, sym))
 			return 0;
-		}
 	}
 
 	/* maybe it is in DT_HASH or DT_GNU_HASH is not present */
 	if (obj->hash) {
-		if (!eh_find_sym_hash(obj, name, &sym)) {
-			*to = (void *) (sym.sym->st_value + obj->addr);
+		if (!eh_find_sym_hash(obj, ref, sym))
 			return 0;
-		}
 	}
 
+	/* no usable hash table, use our own */
+	if (!obj->hash && !obj->gnu_hash)
+		return eh_find_sym_index(obj, ref, sym);
+
 	return EAGAIN;
 }
 
+int eh_find_sym(eh_obj_t *obj, const char *name, void **to)
+{
+	struct eh_gnu_hash_table table;
+	eh_symref_t ref;
+	eh_sym_t sym;
+
+	eh_init_symref(&ref, name);
+	if (eh_find_sym_ref(obj, eh_gnu_hash_parse(obj, &table) ? NULL : &table, &ref, &sym))
+		return EAGAIN;
+
+	*to = (void *) (sym.sym->st_value + obj->addr);
+	return 0;
+}
+
+int eh_find_syms(eh_obj_t *obj, eh_symref_t *refs, unsigned int nrefs, void **to)
+{
+	struct eh_gnu_hash_table table, *ptable = &table;
+	unsigned int i;
+	eh_sym_t sym;
+	int ret = 0;
+
+	if (eh_gnu_hash_parse(obj, &table))
+		ptable = NULL;
+
+	for (i = 0; i < nrefs; i++) {
+		if (eh_find_sym_ref(obj, ptable, &refs[i], &sym)) {
+			to[i] = NULL;
+			ret = EAGAIN;
+		} else
+			to[i] = (void *) (sym.sym->st_value + obj->addr);
+	}
+
+	return ret;
+}
+
 ElfW(Word) eh_hash_elf(const char *name)
 {
 	ElfW(Word) tmp, hash = 0;
@@ -266,9 +634,9 @@ ElfW(Word) eh_hash_elf(const char *name)
 	return hash;
 }
 
-int eh_find_sym_hash(eh_obj_t *obj, const char *name, eh_sym_t *sym)
+int eh_find_sym_hash(eh_obj_t *obj, eh_symref_t *ref, eh_sym_t *sym)
 {
-	ElfW(Word) hash, *chain;
+	ElfW(Word) *chain;
 	ElfW(Sym) *esym;
 	unsigned int bucket_idx, idx;
 
@@ -278,12 +646,17 @@ int eh_find_sym_hash(eh_obj_t *obj, const char *name, eh_sym_t *sym)
 	if (obj->hash[0] == 0)
 		return EAGAIN;
 
-	hash = eh_hash_elf(name);
+	/* DT_HASH is the fallback, so its hash is computed only when needed */
+	if (!(ref->flags & EH_SYMREF_ELF)) {
+		ref->elf_hash = eh_hash_elf(ref->name);
+		ref->flags |= EH_SYMREF_ELF;
+	}
+
 	/*
 	 First item in DT_HASH is nbucket, second is nchain.
 	 hash % nbucket gives us our bucket index.
 	*/
-	bucket_idx = obj->hash[2 + (hash % obj->hash[0])];
+	bucket_idx = obj->hash[2 + (ref->elf_hash % obj->hash[0])];
 	chain = &obj->hash[2 + obj->hash[0] + bucket_idx];
 
 	idx = 0;
@@ -291,19 +664,15 @@ int eh_find_sym_hash(eh_obj_t *obj, const char *name, eh_sym_t *sym)
 
 	/* we have to check symtab[bucket_idx] first */
 	esym = &obj->symtab[bucket_idx];
-	if (esym->st_name) {
-		if (!strcmp(&obj->strtab[esym->st_name], name))
-			sym->sym = esym;
-	}
+	if (eh_match_sym(obj, esym, ref))
+		sym->sym = esym;
 
 	while ((sym->sym == NULL) &&
 	       (chain[idx] != STN_UNDEF)) {
 		esym = &obj->symtab[chain[idx]];
 
-		if (esym->st_name) {
-			if (!strcmp(&obj->strtab[esym->st_name], name))
-				sym->sym = esym;
-		}
+		if (eh_match_sym(obj, esym, ref))
+			sym->sym = esym;
 
 		idx++;
 	}
@@ -330,23 +699,25 @@ Elf32_Word eh_hash_gnu(const char *name)
 	return hash & 0xffffffff;
 }
 
-int eh_find_sym_gnu_hash(eh_obj_t *obj, const char *name, eh_sym_t *sym)
+Elf32_Word eh_hash_gnu_len(const char *name, size_t len)
 {
-	Elf32_Word *buckets, *chain_zero, *hasharr;
-	ElfW(Addr) *bitmask, bitmask_word;
-	Elf32_Word symbias, bitmask_nwords, bucket,
-		   nbuckets, bitmask_idxbits, shift;
-	Elf32_Word hash, hashbit1, hashbit2;
-	ElfW(Sym) *esym;
+	Elf32_Word hash = 5381;
+	const unsigned char *uname = (const unsigned char *) name;
+
+	while (len--)
+		hash = (hash << 5) + hash + *uname++;
 
+	return hash & 0xffffffff;
+}
+
+int eh_gnu_hash_parse(eh_obj_t *obj, struct eh_gnu_hash_table *table)
+{
 	if (!obj->gnu_hash)
 		return ENOTSUP;
 
 	if (obj->gnu_hash[0] == 0)
 		return EAGAIN;
 
-	sym->sym = NULL;
-
 	/*
 	 Initialize our hash table stuff
 
@@ -356,43 +727,53 @@ int eh_find_sym_gnu_hash(eh_obj_t *obj, const char *name, eh_sym_t *sym)
 	 [nbuckets * Elf32_Word] <- buckets
 	 ...chains? - symbias...
 	 */
-	nbuckets = obj->gnu_hash[0];
-	symbias = obj->gnu_hash[1];
-	bitmask_nwords = obj->gnu_hash[2]; /* must be power of two */
-	bitmask_idxbits = bitmask_nwords - 1;
-	shift = obj->gnu_hash[3];
-	bitmask = (ElfW(Addr) *) &obj->gnu_hash[4];
-	buckets = &obj->gnu_hash[4 + (__ELF_NATIVE_CLASS / 32) * bitmask_nwords];
-	chain_zero = &buckets[nbuckets] - symbias;
-
-	/* hash our symbol */
-	hash = eh_hash_gnu(name);
+	table->nbuckets = obj->gnu_hash[0];
+	table->symbias = obj->gnu_hash[1];
+	table->bitmask_nwords = obj->gnu_hash[2]; /* must be power of two */
+	table->bitmask_idxbits = table->bitmask_nwords - 1;
+	table->shift = obj->gnu_hash[3];
+	table->bitmask = (ElfW(Addr) *) &obj->gnu_hash[4];
+	table->buckets = &obj->gnu_hash[4 + (__ELF_NATIVE_CLASS / 32) * table->bitmask_nwords];
+	table->chain_zero = &table->buckets[table->nbuckets] - table->symbias;
+
+	return 0;
+}
+
+int eh_gnu_hash_lookup(eh_obj_t *obj, struct eh_gnu_hash_table *table, eh_symref_t *ref, eh_sym_t *sym)
+{
+	Elf32_Word *hasharr;
+	ElfW(Addr) bitmask_word;
+	Elf32_Word hash, hashbit1, hashbit2, bucket;
+	ElfW(Sym) *esym;
+
+	sym->sym = NULL;
+
+	/* prehashed */
+	hash = ref->gnu_hash;
 
 	/* bitmask stuff... no idea really :D */
-	bitmask_word = bitmask[(hash / __ELF_NATIVE_CLASS) & bitmask_idxbits];
+	bitmask_word = table->bitmask[(hash / __ELF_NATIVE_CLASS) & table->bitmask_idxbits];
 	hashbit1 = hash & (__ELF_NATIVE_CLASS - 1);
-	hashbit2 = (hash >> shift) & (__ELF_NATIVE_CLASS - 1);
+	hashbit2 = (hash >> table->shift) & (__ELF_NATIVE_CLASS - 1);
 
 	/* wtf this does actually? */
 	if (!((bitmask_word >> hashbit1) & (bitmask_word >> hashbit2) & 1))
 		return EAGAIN;
 
 	/* locate bucket */
-	bucket = buckets[hash % nbuckets];
+	bucket = table->buckets[hash % table->nbuckets];
 	if (bucket == 0)
 		return EAGAIN;
 
 	/* and find match in chain */
-	hasharr = &chain_zero[bucket];
+	hasharr = &table->chain_zero[bucket];
 	do {
 		if (((*hasharr ^ hash) >> 1) == 0) {
 			/* hash matches, but does the name? */
-			esym = &obj->symtab[hasharr - chain_zero];
-			if (esym->st_name) {
-				if (!strcmp(&obj->strtab[esym->st_name], name)) {
-					sym->sym = esym;
-					break;
-				}
+			esym = &obj->symtab[hasharr - table->chain_zero];
+			if (eh_match_sym(obj, esym, ref)) {
+				sym->sym = esym;
+				break;
 			}
 		}
 	} while ((*hasharr++ & 1u) == 0);
@@ -407,11 +788,151 @@ int eh_find_sym_gnu_hash(eh_obj_t *obj, const char *name, eh_sym_t *sym)
 	return 0;
 }
 
-int eh_iterate_sym(eh_obj_t *obj, eh_iterate_sym_callback_func callback, void *arg)
+int eh_find_sym_gnu_hash(eh_obj_t *obj, eh_symref_t *ref, eh_sym_t *sym)
+{
+	struct eh_gnu_hash_table table;
+	int ret;
+
+	if ((ret = eh_gnu_hash_parse(obj, &table)))
+		return ret;
+
+	return eh_gnu_hash_lookup(obj, &table, ref, sym);
+}
+
+int eh_count_syms(eh_obj_t *obj)
 {
+	Elf32_Word *buckets, *chain_zero;
+	Elf32_Word nbuckets, symbias, bucket, max = 0;
+
+	if (obj->nsyms)
+		return 0;
+
+	/* nchain equals number of symbols */
+	if (obj->hash) {
+		obj->nsyms = obj->hash[1];
+		return 0;
+	}
+
+	/*
+	 DT_GNU_HASH does not store the count. The highest bucket start
+	 leads to the last chain, whose last entry has bit 0 set.
+	*/
+	if (obj->gnu_hash) {
+		nbuckets = obj->gnu_hash[0];
+		symbias = obj->gnu_hash[1];
+		buckets = &obj->gnu_hash[4 + (__ELF_NATIVE_CLASS / 32) * obj->gnu_hash[2]];
+		chain_zero = &buckets[nbuckets] - symbias;
+
+		for (bucket = 0; bucket < nbuckets; bucket++) {
+			if (buckets[bucket] > max)
+				max = buckets[bucket];
+		}
+
+		if (max == 0) {
+			obj->nsyms = symbias;
+		} else {
+			while ((chain_zero[max] & 1u) == 0)
+				max++;
+			obj->nsyms = max + 1;
+		}
+
+		return 0;
+	}
+
+	/* nothing else bounds .dynsym, section layout is up to the linker */
 	return ENOTSUP;
 }
 
+int eh_build_index(eh_obj_t *obj)
+{
+	Elf32_Word hash, slot, size = 4;
+	ElfW(Sym) *esym;
+	ElfW(Word) i;
+	int ret;
+
+	if (obj->index)
+		return 0;
+
+	if ((ret = eh_count_syms(obj)))
+		return ret;
+
+	/* at most half full */
+	while (size < obj->nsyms * 2)
+		size <<= 1;
+
+	obj->index = calloc(size * 2, sizeof(Elf32_Word));
+	if (!obj->index)
+		return ENOMEM;
+	obj->index_mask = size - 1;
+
+	/* symbol 0 is always undefined, so index 0 marks empty slots */
+	for (i = 1; i < obj->nsyms; i++) {
+		esym = &obj->symtab[i];
+		if (!esym->st_name || esym->st_shndx == SHN_UNDEF)
+			continue;
+
+		hash = eh_hash_gnu(&obj->strtab[esym->st_name]);
+		slot = hash & obj->index_mask;
+		while (obj->index[slot * 2 + 1])
+			slot = (slot + 1) & obj->index_mask;
+
+		obj->index[slot * 2] = hash;
+		obj->index[slot * 2 + 1] = i;
+	}
+
+	return 0;
+}
+
+int eh_find_sym_index(eh_obj_t *obj, eh_symref_t *ref, eh_sym_t *sym)
+{
+	Elf32_Word slot;
+	ElfW(Sym) *esym;
+	int ret;
+
+	if ((ret = eh_build_index(obj)))
+		return ret;
+
+	slot = ref->gnu_hash & obj->index_mask;
+	while (obj->index[slot * 2 + 1]) {
+		if (obj->index[slot * 2] == ref->gnu_hash) {
+			esym = &obj->symtab[obj->index[slot * 2 + 1]];
+			if (eh_match_sym(obj, esym, ref)) {
+				sym->sym = esym;
+				sym->obj = obj;
+				sym->name = &obj->strtab[esym->st_name];
+				return 0;
+			}
+		}
+		slot = (slot + 1) & obj->index_mask;
+	}
+
+	return EAGAIN;
+}
+
+int eh_iterate_sym(eh_obj_t *obj, eh_iterate_sym_callback_func callback, void *arg)
+{
+	eh_sym_t sym;
+	ElfW(Word) i;
+	int ret;
+
+	if ((ret = eh_count_syms(obj)))
+		return ret;
+
+	sym.obj = obj;
+	for (i = 0; i < obj->nsyms; i++) {
+		sym.sym = &obj->symtab[i];
+		if (sym.sym->st_name)
+			sym.name = &obj->strtab[sym.sym->st_name];
+		else
+			sym.name = NULL;
+
+		if ((ret = callback(&sym, arg)))
+			return ret;
+	}
+
+	return 0;
+}
+
 int eh_find_next_dyn(eh_obj_t *obj, ElfW_Sword tag, int i, ElfW(Dyn) **next)
 {
 	/* first from i + 1 to end, then from start to i - 1 */
@@ -510,6 +1031,179 @@ int eh_set_rel(eh_obj_t *obj, const char *sym, void *val)
 	return 0;
 }
 
+int eh_create_rel_set(eh_rel_set_t *set, eh_rel_patch_t *patch, unsigned int npatch)
+{
+	unsigned int i, slot, size = 4;
+
+	/* at most half full, so probes stay short */
+	while (size < npatch * 2)
+		size <<= 1;
+
+	set->patch = patch;
+	set->npatch = npatch;
+	set->mask = size - 1;
+	set->hash = malloc(sizeof(Elf32_Word) * (npatch ? npatch : 1));
+	set->index = calloc(size, sizeof(unsigned int));
+	if (!set->hash || !set->index) {
+		free(set->hash);
+		free(set->index);
+		return ENOMEM;
+	}
+
+	for (i = 0; i < npatch; i++) {
+		set->hash[i] = eh_hash_gnu(patch[i].name);
+		slot = set->hash[i] & set->mask;
+		while (set->index[slot])
+			slot = (slot + 1) & set->mask;
+		set->index[slot] = i + 1;
+	}
+
+	return 0;
+}
+
+int eh_rel_set_find(eh_rel_set_t *set, const char *name)
+{
+	Elf32_Word hash = eh_hash_gnu(name);
+	unsigned int slot = hash & set->mask, i;
+
+	while ((i = set->index[slot])) {
+		if (set->hash[i - 1] == hash && !strcmp(set->patch[i - 1].name, name))
+			return i - 1;
+		slot = (slot + 1) & set->mask;
+	}
+
+	return -1;
+}
+
+int eh_set_rels_slot(eh_obj_t *obj, struct eh_rels_args *args, ElfW(Word) symidx, ElfW(Addr) offset)
+{
+	ElfW(Sym) *sym = &obj->symtab[symidx];
+	ElfW(Addr) page = sysconf(_SC_PAGESIZE);
+	eh_rel_patch_t *patch;
+	void **slot, *page_start;
+	int i, relro;
+
+	/* imports only, objects calling their own exports are left alone */
+	if (!sym->st_name || sym->st_shndx != SHN_UNDEF)
+		return 0;
+
+	if ((i = eh_rel_set_find(args->set, &obj->strtab[sym->st_name])) < 0)
+		return 0;
+
+	patch = &args->set->patch[i];
+	slot = (void **) (offset + obj->addr);
+	if (*slot == patch->val)
+		return 0;
+
+	page_start = (void *) ((ElfW(Addr)) slot & ~(page - 1));
+	relro = (ElfW(Addr)) slot >= args->relro_start && (ElfW(Addr)) slot < args->relro_end;
+	if (relro && mprotect(page_start, page, PROT_READ | PROT_WRITE))
+		return errno;
+
+	if (patch->old)
+		*patch->old = *slot;
+	__atomic_store_n(slot, patch->val, __ATOMIC_RELEASE);
+	patch->count++;
+
+	if (relro)
+		mprotect(page_start, page, PROT_READ);
+
+	return 0;
+}
+
+int eh_set_rels_rela(eh_obj_t *obj, struct eh_rels_args *args, ElfW(Rela) *rela, size_t n, int plt)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < n; i++) {
+		if (!plt && ELFW_R_TYPE(rela[i].r_info) != EH_R_GLOB_DAT)
+			continue;
+
+		if ((ret = eh_set_rels_slot(obj, args, ELFW_R_SYM(rela[i].r_info), rela[i].r_offset)))
+			return ret;
+	}
+
+	return 0;
+}
+
+int eh_set_rels_rel(eh_obj_t *obj, struct eh_rels_args *args, ElfW(Rel) *rel, size_t n, int plt)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < n; i++) {
+		if (!plt && ELFW_R_TYPE(rel[i].r_info) != EH_R_GLOB_DAT)
+			continue;
+
+		if ((ret = eh_set_rels_slot(obj, args, ELFW_R_SYM(rel[i].r_info), rel[i].r_offset)))
+			return ret;
+	}
+
+	return 0;
+}
+
+int eh_set_rels(eh_obj_t *obj, eh_rel_set_t *set)
+{
+	ElfW(Addr) page = sysconf(_SC_PAGESIZE);
+	struct eh_rels_args args;
+	ElfW(Dyn) *size, *pltrel;
+	int ret = 0, p;
+
+	args.set = set;
+	args.relro_start = args.relro_end = 0;
+	for (p = 0; p < obj->phnum; p++) {
+		if (obj->phdr[p].p_type == PT_GNU_RELRO) {
+			/* ld.so protects whole pages only */
+			args.relro_start = (obj->addr + obj->phdr[p].p_vaddr) & ~(page - 1);
+			args.relro_end = (obj->addr + obj->phdr[p].p_vaddr + obj->phdr[p].p_memsz) & ~(page - 1);
+		}
+	}
+
+	p = 0;
+	while (obj->dynamic[p].d_tag != DT_NULL && !ret) {
+		if (obj->dynamic[p].d_tag == DT_JMPREL) {
+			if (eh_find_next_dyn(obj, DT_PLTRELSZ, p, &size) ||
+			    eh_find_next_dyn(obj, DT_PLTREL, p, &pltrel))
+				return EINVAL;
+
+			if (pltrel->d_un.d_val == DT_RELA)
+				ret = eh_set_rels_rela(obj, &args, (ElfW(Rela) *) obj->dynamic[p].d_un.d_ptr,
+						       size->d_un.d_val / sizeof(ElfW(Rela)), 1);
+			else if (pltrel->d_un.d_val == DT_REL)
+				ret = eh_set_rels_rel(obj, &args, (ElfW(Rel) *) obj->dynamic[p].d_un.d_ptr,
+						      size->d_un.d_val / sizeof(ElfW(Rel)), 1);
+			else
+				return EINVAL;
+		} else if (obj->dynamic[p].d_tag == DT_RELA) {
+			if (eh_find_next_dyn(obj, DT_RELASZ, p, &size))
+				return EINVAL;
+
+			ret = eh_set_rels_rela(obj, &args, (ElfW(Rela) *) obj->dynamic[p].d_un.d_ptr,
+					       size->d_un.d_val / sizeof(ElfW(Rela)), 0);
+		} else if (obj->dynamic[p].d_tag == DT_REL) {
+			if (eh_find_next_dyn(obj, DT_RELSZ, p, &size))
+				return EINVAL;
+
+			ret = eh_set_rels_rel(obj, &args, (ElfW(Rel) *) obj->dynamic[p].d_un.d_ptr,
+					      size->d_un.d_val / sizeof(ElfW(Rel)), 0);
+		}
+		p++;
+	}
+
+	return ret;
+}
+
+int eh_destroy_rel_set(eh_rel_set_t *set)
+{
+	free(set->hash);
+	free(set->index);
+	set->hash = NULL;
+	set->index = NULL;
+
+	return 0;
+}
+
 int eh_iterate_rela_plt(eh_obj_t *obj, int p, eh_iterate_rel_callback_func callback, void *arg)
 {
 	ElfW(Rela) *rela = (ElfW(Rela) *) obj->dynamic[p].d_un.d_ptr;
@@ -598,6 +1292,9 @@ int eh_destroy_obj(eh_obj_t *obj)
 {
 	obj->phdr = NULL;
 
+	free(obj->index);
+	obj->index = NULL;
+
 	return 0;
 }
 
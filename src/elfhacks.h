@@ -47,11 +47,15 @@ extern "C" {
 
 #ifdef __elf64
 # define ELFW_R_SYM ELF64_R_SYM
+# define ELFW_R_TYPE ELF64_R_TYPE
 # define ElfW_Sword Elf64_Sxword
+# define EH_R_GLOB_DAT R_X86_64_GLOB_DAT
 #else
 # ifdef __elf32
 #  define ELFW_R_SYM ELF32_R_SYM
+#  define ELFW_R_TYPE ELF32_R_TYPE
 #  define ElfW_Sword Elf32_Sword
+#  define EH_R_GLOB_DAT R_386_GLOB_DAT
 # else
 #  error neither __elf32 nor __elf64 is defined
 # endif
@@ -68,7 +72,7 @@ extern "C" {
  * \brief elfhacks program object
  */
 typedef struct {
-	/** file name */
+	/** file name, owned by the loader or registry, gone once unloaded */
 	const char *name;
 	/** base address in memory */
 	ElfW(Addr) addr;
@@ -86,6 +90,13 @@ typedef struct {
 	ElfW(Word) *hash;
 	/** symbol hash table (DT_GNU_HASH) */
 	Elf32_Word *gnu_hash;
+	/** number of .dynsym entries, 0 until counted */
+	ElfW(Word) nsyms;
+	/** fallback index of defined symbols when there is no usable hash
+	    table, (hash, symbol index) pairs, built on first lookup */
+	Elf32_Word *index;
+	/** number of index slots - 1 */
+	Elf32_Word index_mask;
 } eh_obj_t;
 
 /**
@@ -114,6 +125,87 @@ typedef struct {
 	eh_obj_t *obj;
 } eh_rel_t;
 
+/** eh_symref_t.gnu_hash is valid */
+#define EH_SYMREF_GNU 0x1
+/** eh_symref_t.elf_hash is valid */
+#define EH_SYMREF_ELF 0x2
+
+/** longest name EH_SYMREF() hashes at compile time */
+#define EH_SYMREF_MAX 64
+
+/**
+ * \brief prehashed symbol name
+ *
+ * Initialize with EH_SYMREF() at compile time or eh_init_symref(). The
+ * DT_HASH hash is filled in on the first lookup that needs it, so refs
+ * must be writable.
+ */
+typedef struct {
+	/** symbol name */
+	const char *name;
+	/** strlen(name) */
+	size_t len;
+	/** DT_GNU_HASH hash of name */
+	Elf32_Word gnu_hash;
+	/** DT_HASH hash of name */
+	ElfW(Word) elf_hash;
+	/** EH_SYMREF_* bits telling which hashes are valid */
+	unsigned int flags;
+} eh_symref_t;
+
+/*
+ DT_GNU_HASH of a string literal as a constant expression. Every step
+ multiplies by 33 and adds the next character, or by 1 and adds 0 past
+ the end, so h appears once per step and expansion stays linear.
+*/
+#define __EH_GH1(s, i, h) \
+	((h) * ((i) < sizeof(s) - 1 ? 33u : 1u) + \
+	 ((i) < sizeof(s) - 1 ? (unsigned char) (s)[(i) < sizeof(s) - 1 ? (i) : 0] : 0u))
+#define __EH_GH4(s, i, h) \
+	__EH_GH1(s, (i) + 3, __EH_GH1(s, (i) + 2, __EH_GH1(s, (i) + 1, __EH_GH1(s, (i), h))))
+#define __EH_GH16(s, i, h) \
+	__EH_GH4(s, (i) + 12, __EH_GH4(s, (i) + 8, __EH_GH4(s, (i) + 4, __EH_GH4(s, (i), h))))
+#define __EH_GH64(s, h) \
+	__EH_GH16(s, 48, __EH_GH16(s, 32, __EH_GH16(s, 16, __EH_GH16(s, 0, h))))
+
+/** DT_GNU_HASH of string literal s, valid up to EH_SYMREF_MAX characters */
+#define EH_GNU_HASH(s) ((Elf32_Word) __EH_GH64(s, 5381u))
+
+/** eh_symref_t initializer for string literal s, longer names are hashed on first lookup */
+#define EH_SYMREF(s) \
+	{ (s), sizeof(s) - 1, EH_GNU_HASH(s), 0, \
+	  sizeof(s) - 1 <= EH_SYMREF_MAX ? EH_SYMREF_GNU : 0 }
+
+/**
+ * \brief one symbol to patch with eh_set_rels()
+ */
+typedef struct {
+	/** symbol to replace */
+	const char *name;
+	/** new value */
+	void *val;
+	/** if not NULL, receives previous value of the last slot patched */
+	void **old;
+	/** number of slots patched so far */
+	unsigned int count;
+} eh_rel_patch_t;
+
+/**
+ * \brief set of symbols to patch, see eh_create_rel_set()
+ */
+typedef struct {
+	/** patches, owned by caller */
+	eh_rel_patch_t *patch;
+	/** number of patches */
+	unsigned int npatch;
+	/** GNU hash of every patch name */
+	Elf32_Word *hash;
+	/** open addressing index, patch index + 1 or 0 */
+	unsigned int *index;
+	/** index size - 1, size is a power of two */
+	unsigned int mask;
+} eh_rel_set_t;
+
 /**
  * \brief Iterate objects callback
  */
@@ -130,8 +222,16 @@ typedef int (*eh_iterate_rel_callback_func)(eh_rel_t *rel, void *arg);
 /**
  * \brief Initializes eh_obj_t for given soname
  *
- * Matching is done using fnmatch() so wildcards and other standard
- * filename metacharacters and expressions work.
+ * Matching is done using fnmatch() on the full path so wildcards and
+ * other standard filename metacharacters and expressions work. A plain
+ * name without a path also matches the base name ("libGL.so.1") or the
+ * stem ("libGL.so"). Loaded objects are kept in a process-wide registry
+ * that is refreshed only after dlopen() or dlclose(). Plain names and
+ * patterns like "*libfoo.so*" are answered from a soname index, the
+ * first indexed match is returned.
+ *
+ * obj->name points into the registry and is valid until the object is
+ * unloaded.
  *
  * If soname is NULL, this function returns the main program object.
  * \param obj elfhacks object
@@ -142,6 +242,9 @@ __PUBLIC int eh_find_obj(eh_obj_t *obj, const char *soname);
 
 /**
  * \brief Walk through list of objects
+ *
+ * Callback gets a copy of the registry entry, parsed when the object
+ * was first seen. It may call dlopen() and other elfhacks functions.
  * \param callback callback function
  * \param arg argument passed to callback function
  * \return 0 on success otherwise an error code
@@ -150,6 +253,10 @@ __PUBLIC int eh_iterate_obj(eh_iterate_obj_callback_func callback, void *arg);
 
 /**
  * \brief Finds symbol in object's .dynsym and retrvieves its value.
+ *
+ * Objects without a usable DT_GNU_HASH or DT_HASH get an index built on
+ * the first lookup and freed by eh_destroy_obj(). That needs obj->nsyms,
+ * lookups fail with ENOTSUP if it was never counted.
  * \param obj elfhacks program object
  * \param name symbol to find
  * \param to returned value
@@ -157,8 +264,31 @@ __PUBLIC int eh_iterate_obj(eh_iterate_obj_callback_func callback, void *arg);
 */
 __PUBLIC int eh_find_sym(eh_obj_t *obj, const char *name, void **to);
 
+/**
+ * \brief Initializes eh_symref_t at run-time
+ * \param ref reference to initialize
+ * \param name symbol name, must outlive ref
+ */
+__PUBLIC void eh_init_symref(eh_symref_t *ref, const char *name);
+
+/**
+ * \brief Resolves array of prehashed symbols in object's .dynsym
+ *
+ * Header of the hash table is parsed once, the DT_GNU_HASH bloom filter
+ * rejects most misses before any bucket or string is touched.
+ * \param obj elfhacks program object
+ * \param refs symbols to find
+ * \param nrefs number of entries in refs
+ * \param to returned values, NULL for symbols not found
+ * \return 0 if all were found, EAGAIN if some were not
+ */
+__PUBLIC int eh_find_syms(eh_obj_t *obj, eh_symref_t *refs, unsigned int nrefs, void **to);
+
 /**
  * \brief Walk through list of symbols in object
+ *
+ * Symbol count comes from DT_HASH or from the DT_GNU_HASH chains. Objects
+ * with neither fail with ENOTSUP unless obj->nsyms is already known.
  * \param obj elfhacks program object
  * \param callback callback function
  * \param arg argument passed to callback function
@@ -176,6 +306,38 @@ __PUBLIC int eh_iterate_sym(eh_obj_t *obj, eh_iterate_sym_callback_func callback
 */
 __PUBLIC int eh_set_rel(eh_obj_t *obj, const char *sym, void *val);
 
+/**
+ * \brief Builds hash set for eh_set_rels()
+ *
+ * patch must stay valid until eh_destroy_rel_set().
+ * \param set set to initialize
+ * \param patch symbols to replace, names must be unique
+ * \param npatch number of entries in patch
+ * \return 0 on success otherwise a positive error code
+ */
+__PUBLIC int eh_create_rel_set(eh_rel_set_t *set, eh_rel_patch_t *patch, unsigned int npatch);
+
+/**
+ * \brief Patches every symbol in set in one pass over object's relocations
+ *
+ * Covers .rel.plt and .rela.plt (DT_JMPREL) as well as GLOB_DAT entries in
+ * DT_RELA and DT_REL, which hold addresses of functions taken by pointer.
+ * Only relocations against symbols the object imports are patched. Slots
+ * inside PT_GNU_RELRO are made writable for the store and read-only again
+ * afterwards.
+ * \param obj elfhacks program object
+ * \param set symbols to replace
+ * \return 0 on success otherwise a positive error code
+ */
+__PUBLIC int eh_set_rels(eh_obj_t *obj, eh_rel_set_t *set);
+
+/**
+ * \brief Frees hash set built by eh_create_rel_set()
+ * \param set set to destroy
+ * \return 0 on success otherwise a positive error code
+ */
+__PUBLIC int eh_destroy_rel_set(eh_rel_set_t *set);
+
 /**
  * \brief Walk through object's .rel.plt and .rela.plt
  * \param obj elfhacks program object
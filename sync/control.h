@@ -0,0 +1,103 @@
+/**
+ * \file sync/control.h
+ * \brief runtime control shared memory layout
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+#ifndef GLSYNC_CONTROL_H
+#define GLSYNC_CONTROL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  \defgroup control control
+ *  With GLSYNC_CONTROL=1 glsync creates a control block in POSIX shared
+ *  memory named GLSYNC_CONTROL_NAME "<pid>", readable and writable by the
+ *  owner only, and checks it on every swap.
+ *
+ *  A controller claims request by moving request_seq from an even value
+ *  to the next odd one with compare-and-swap, fills it and releases it by
+ *  storing the next even value. glsync copies request out only while
+ *  request_seq is even and unchanged across the copy, applies it as a
+ *  whole or not at all at the start of a swap, and then stores
+ *  request_seq into done and the outcome into status. current is
+ *  published the same way through current_seq, by glsync only.
+ *  \{
+ */
+
+/** shared memory object name prefix, followed by pid */
+#define GLSYNC_CONTROL_NAME "/glsync-ctl."
+
+/** "GLSC" */
+#define GLSYNC_CONTROL_MAGIC 0x43534c47
+
+/** layout version, bumped on every change */
+#define GLSYNC_CONTROL_VERSION 1
+
+/** depth value selecting the adaptive controller (GLSYNC_DEPTH=auto) */
+#define GLSYNC_CONTROL_DEPTH_AUTO 0xffffffffu
+
+/**
+ * \brief settings that can be changed at runtime
+ *
+ * Same meaning and limits as the environment variables.
+ */
+struct glsync_settings_s {
+	/** frames allowed in flight (GLSYNC_DEPTH) or GLSYNC_CONTROL_DEPTH_AUTO */
+	uint32_t depth;
+
+	/** frame rate cap (GLSYNC_FPS), 0 if none */
+	uint32_t fps;
+
+	/** per-frame telemetry (GLSYNC_TELEMETRY), 0 or 1 */
+	uint32_t telemetry;
+
+	/** fence wait policy (GLSYNC_WAIT), NUL terminated */
+	char wait[12];
+};
+
+/**
+ * \brief shared memory segment
+ */
+struct glsync_control_s {
+	/** GLSYNC_CONTROL_MAGIC */
+	uint32_t magic;
+
+	/** GLSYNC_CONTROL_VERSION */
+	uint32_t version;
+
+	/** pid of the process, for controllers that found the block by name */
+	uint32_t pid;
+
+	/** odd while current is being written, own cache line */
+	uint32_t current_seq __attribute__ ((aligned (64)));
+
+	/** settings in effect */
+	struct glsync_settings_s current;
+
+	/** request_seq of the last request handled */
+	uint32_t done;
+
+	/** outcome of that request, 0 or an errno value */
+	int32_t status;
+
+	/** odd while request is being written, own cache line */
+	uint32_t request_seq __attribute__ ((aligned (64)));
+
+	/** settings asked for, all of them, unchanged ones copied from current */
+	struct glsync_settings_s request;
+};
+
+/** \} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * \file sync/glsync-ctl.c
+ * \brief changes glsync settings of a running process
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+/*
+ Use:
+ GLSYNC_CONTROL=1 LD_PRELOAD=libglsync.so [some opengl app] &
+ glsync-ctl <pid> [depth=<n>|auto] [fps=<n>] [wait=block|poll|hybrid] [telemetry=0|1]
+
+ Without settings prints the ones in effect. Settings not given are left
+ as they are. The process applies them at its next swap, this waits for
+ that for up to a second.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "control.h"
+
+/** how long to wait for the process to swap, in ms */
+#define CTL_TIMEOUT_MS 1000
+
+/**
+ * \brief copies out settings in effect
+ */
+static void read_current(struct glsync_control_s *ctl, struct glsync_settings_s *out)
+{
+	uint32_t seq;
+
+	for (;;) {
+		seq = __atomic_load_n(&ctl->current_seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		memcpy(out, &ctl->current, sizeof(*out));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&ctl->current_seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+	out->wait[sizeof(out->wait) - 1] = '\0';
+}
+
+static void print_settings(const struct glsync_settings_s *s)
+{
+	if (s->depth == GLSYNC_CONTROL_DEPTH_AUTO)
+		printf("depth=auto");
+	else
+		printf("depth=%u", s->depth);
+	printf(" fps=%u wait=%s telemetry=%u\n", s->fps, s->wait, s->telemetry);
+}
+
+/**
+ * \brief parses one name=value argument into settings
+ * \return 0 on success
+ */
+static int parse_setting(const char *arg, struct glsync_settings_s *s)
+{
+	const char *val = strchr(arg, '=');
+	char *end;
+	unsigned long n;
+
+	if (val == NULL)
+		return 1;
+	val++;
+
+	if (!strncmp(arg, "wait=", 5)) {
+		if (strlen(val) >= sizeof(s->wait))
+			return 1;
+		memset(s->wait, 0, sizeof(s->wait));
+		strcpy(s->wait, val);
+		return 0;
+	}
+
+	if (!strncmp(arg, "depth=", 6) && !strcmp(val, "auto")) {
+		s->depth = GLSYNC_CONTROL_DEPTH_AUTO;
+		return 0;
+	}
+
+	n = strtoul(val, &end, 10);
+	if (*val == '\0' || *end != '\0' || n > 0xffffu)
+		return 1;
+
+	if (!strncmp(arg, "depth=", 6))
+		s->depth = n;
+	else if (!strncmp(arg, "fps=", 4))
+		s->fps = n;
+	else if (!strncmp(arg, "telemetry=", 10))
+		s->telemetry = n;
+	else
+		return 1;
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct glsync_control_s *ctl;
+	struct glsync_settings_s set;
+	struct timespec ts = { 0, 1000000 };
+	char name[32];
+	uint32_t seq;
+	unsigned int ms;
+	int fd, i;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <pid> [depth=<n>|auto] [fps=<n>] "
+			"[wait=block|poll|hybrid] [telemetry=0|1]\n", argv[0]);
+		return 1;
+	}
+
+	snprintf(name, sizeof(name), GLSYNC_CONTROL_NAME "%d", atoi(argv[1]));
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0) {
+		perror(name);
+		return 1;
+	}
+
+	ctl = mmap(NULL, sizeof(struct glsync_control_s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ctl == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	if (__atomic_load_n(&ctl->magic, __ATOMIC_ACQUIRE) != GLSYNC_CONTROL_MAGIC ||
+	    ctl->version != GLSYNC_CONTROL_VERSION) {
+		fprintf(stderr, "%s: unsupported control layout\n", name);
+		return 1;
+	}
+
+	read_current(ctl, &set);
+	if (argc == 2) {
+		print_settings(&set);
+		return 0;
+	}
+
+	for (i = 2; i < argc; i++) {
+		if (parse_setting(argv[i], &set)) {
+			fprintf(stderr, "%s: invalid setting %s\n", argv[0], argv[i]);
+			return 1;
+		}
+	}
+
+	/* claim request, another glsync-ctl may be writing it */
+	do {
+		seq = __atomic_load_n(&ctl->request_seq, __ATOMIC_RELAXED);
+	} while ((seq & 1) ||
+		 !__atomic_compare_exchange_n(&ctl->request_seq, &seq, seq + 1, 0,
+					      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+	memcpy(&ctl->request, &set, sizeof(set));
+	__atomic_store_n(&ctl->request_seq, seq + 2, __ATOMIC_RELEASE);
+
+	/* a later request handled first covers ours too */
+	for (ms = 0; (int32_t) (__atomic_load_n(&ctl->done, __ATOMIC_ACQUIRE) - (seq + 2)) < 0; ms++) {
+		if (ms == CTL_TIMEOUT_MS) {
+			fprintf(stderr, "%s: not applied yet, process has not swapped\n", argv[0]);
+			return 1;
+		}
+		nanosleep(&ts, NULL);
+	}
+
+	if (ctl->status == ENOTSUP) {
+		fprintf(stderr, "%s: async wait can only be set at load time\n", argv[0]);
+		return 1;
+	} else if (ctl->status) {
+		fprintf(stderr, "%s: rejected: %s\n", argv[0], strerror(ctl->status));
+		return 1;
+	}
+
+	read_current(ctl, &set);
+	print_settings(&set);
+
+	return 0;
+}
@@ -0,0 +1,316 @@
+/**
+ * \file sync/glsync-profiles.c
+ * \brief compiles glsync profiles into the database glsync maps at startup
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+/*
+ Use:
+ glsync-profiles <profiles.conf> <profiles.db>
+
+ One profile per line, '#' starts a comment:
+  <executable path or process name> <setting>...
+ Settings:
+  off                  - glsync only forwards calls
+  mode=fence|jit|vblank
+  depth=<0-8>|auto
+  fps=<0-1000>
+  hooks=<dl,glx,egl,got>|none - lookups glsync returns its hooks from
+
+ The database is written next to its final name and renamed over it, so
+ processes starting meanwhile see either the old or the new one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "profiles.h"
+
+/** longest line accepted */
+#define PROFILES_LINE 4096
+
+/** GLSYNC_MODE keywords, as glsync knows them */
+static const char *modes[] = { "fence", "jit", "vblank", NULL };
+
+/**
+ * \brief profile being compiled
+ */
+struct entry_s {
+	char *key;
+	const char *mode;
+	struct glsync_profile_s profile;
+};
+
+/**
+ * \brief growing string table
+ */
+struct strings_s {
+	char *data;
+	size_t size;
+	size_t alloc;
+};
+
+/**
+ * \brief appends string to table
+ * \return offset within table
+ */
+static size_t strings_add(struct strings_s *s, const char *str)
+{
+	size_t len = strlen(str) + 1, off = s->size;
+
+	if (s->size + len > s->alloc) {
+		s->alloc = (s->size + len) * 2;
+		s->data = realloc(s->data, s->alloc);
+		if (s->data == NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	memcpy(s->data + s->size, str, len);
+	s->size += len;
+	return off;
+}
+
+/**
+ * \brief parses unsigned number no larger than max
+ * \return 0 on success
+ */
+static int parse_uint(const char *str, uint32_t max, uint32_t *out)
+{
+	char *end;
+	unsigned long val;
+
+	errno = 0;
+	val = strtoul(str, &end, 10);
+	if (*str == '\0' || *end != '\0' || errno || val > max)
+		return 1;
+
+	*out = val;
+	return 0;
+}
+
+/**
+ * \brief parses comma separated hook lookups
+ * \return 0 on success
+ */
+static int parse_hooks(char *str, uint32_t *out)
+{
+	char *name, *save;
+
+	*out = 0;
+	if (!strcmp(str, "none"))
+		return 0;
+
+	for (name = strtok_r(str, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+		if (!strcmp(name, "dl"))
+			*out |= GLSYNC_PROFILE_HOOK_DL;
+		else if (!strcmp(name, "glx"))
+			*out |= GLSYNC_PROFILE_HOOK_GLX;
+		else if (!strcmp(name, "egl"))
+			*out |= GLSYNC_PROFILE_HOOK_EGL;
+		else if (!strcmp(name, "got"))
+			*out |= GLSYNC_PROFILE_HOOK_GOT;
+		else
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief parses one setting into entry
+ * \return 0 on success
+ */
+static int parse_setting(char *str, struct entry_s *e)
+{
+	char *val = strchr(str, '=');
+	unsigned int i;
+
+	if (!strcmp(str, "off")) {
+		e->profile.flags |= GLSYNC_PROFILE_OFF;
+		return 0;
+	}
+
+	if (val == NULL)
+		return 1;
+	*val++ = '\0';
+
+	if (!strcmp(str, "mode")) {
+		for (i = 0; modes[i]; i++) {
+			if (!strcmp(val, modes[i])) {
+				e->mode = modes[i];
+				return 0;
+			}
+		}
+		return 1;
+	} else if (!strcmp(str, "depth")) {
+		if (!strcmp(val, "auto")) {
+			e->profile.depth = GLSYNC_PROFILE_DEPTH_AUTO;
+			return 0;
+		}
+		return parse_uint(val, 8, &e->profile.depth);
+	} else if (!strcmp(str, "fps"))
+		return parse_uint(val, 1000, &e->profile.fps);
+	else if (!strcmp(str, "hooks"))
+		return parse_hooks(val, &e->profile.hooks);
+
+	return 1;
+}
+
+/**
+ * \brief reads profile list
+ * \return number of profiles, exits on error
+ */
+static unsigned int read_profiles(const char *path, struct entry_s **out)
+{
+	struct entry_s *entry = NULL, *e;
+	unsigned int count = 0, alloc = 0, lineno = 0, i;
+	char line[PROFILES_LINE], *tok, *save, *hash;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (strchr(line, '\n') == NULL && !feof(f)) {
+			fprintf(stderr, "%s:%u: line too long\n", path, lineno);
+			exit(1);
+		}
+
+		hash = strchr(line, '#');
+		if (hash)
+			*hash = '\0';
+
+		tok = strtok_r(line, " \t\r\n", &save);
+		if (tok == NULL)
+			continue;
+
+		if (count == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			entry = realloc(entry, alloc * sizeof(struct entry_s));
+			if (entry == NULL) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+
+		for (i = 0; i < count; i++) {
+			if (!strcmp(entry[i].key, tok)) {
+				fprintf(stderr, "%s:%u: %s already has a profile\n", path, lineno, tok);
+				exit(1);
+			}
+		}
+
+		e = &entry[count++];
+		memset(e, 0, sizeof(struct entry_s));
+		e->key = strdup(tok);
+		e->profile.hooks = GLSYNC_PROFILE_UNSET;
+		e->profile.depth = GLSYNC_PROFILE_UNSET;
+		e->profile.fps = GLSYNC_PROFILE_UNSET;
+
+		while ((tok = strtok_r(NULL, " \t\r\n", &save))) {
+			if (parse_setting(tok, e)) {
+				fprintf(stderr, "%s:%u: invalid setting %s\n", path, lineno, tok);
+				exit(1);
+			}
+		}
+	}
+
+	fclose(f);
+	*out = entry;
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	struct glsync_profiles_s *db;
+	struct strings_s strings = { NULL, 0, 0 };
+	struct entry_s *entry;
+	unsigned int count, buckets, i, slot;
+	size_t table, size;
+	char tmp[4096];
+	FILE *f;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <profiles.conf> <profiles.db>\n", argv[0]);
+		return 1;
+	}
+
+	count = read_profiles(argv[1], &entry);
+
+	/* at most half full keeps misses to a probe or two */
+	for (buckets = 8; buckets < count * 2; buckets *= 2)
+		;
+
+	table = sizeof(struct glsync_profiles_s) + buckets * sizeof(struct glsync_profile_s);
+	db = calloc(1, table);
+	if (db == NULL) {
+		perror("calloc");
+		return 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		entry[i].profile.hash = glsync_profile_hash(entry[i].key);
+		entry[i].profile.key = table + strings_add(&strings, entry[i].key);
+		if (entry[i].mode)
+			entry[i].profile.mode = table + strings_add(&strings, entry[i].mode);
+
+		slot = entry[i].profile.hash & (buckets - 1);
+		while (db->profile[slot].key)
+			slot = (slot + 1) & (buckets - 1);
+		db->profile[slot] = entry[i].profile;
+	}
+
+	/* ends with NUL even without profiles */
+	strings_add(&strings, "");
+
+	size = table + strings.size;
+	if (size > UINT32_MAX) {
+		fprintf(stderr, "%s: too many profiles\n", argv[0]);
+		return 1;
+	}
+
+	db->magic = GLSYNC_PROFILES_MAGIC;
+	db->version = GLSYNC_PROFILES_VERSION;
+	db->size = size;
+	db->buckets = buckets;
+	db->count = count;
+	db->profile_size = sizeof(struct glsync_profile_s);
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", argv[2]);
+	f = fopen(tmp, "wb");
+	if (f == NULL) {
+		perror(tmp);
+		return 1;
+	}
+
+	if (fwrite(db, table, 1, f) != 1 || fwrite(strings.data, strings.size, 1, f) != 1 ||
+	    fclose(f)) {
+		perror(tmp);
+		remove(tmp);
+		return 1;
+	}
+
+	if (rename(tmp, argv[2])) {
+		perror(argv[2]);
+		remove(tmp);
+		return 1;
+	}
+
+	printf("%s: %u profiles, %u buckets, %zu bytes\n", argv[2], count, buckets, size);
+	for (i = 0; i < count; i++)
+		free(entry[i].key);
+	free(entry);
+	free(strings.data);
+	free(db);
+
+	return 0;
+}
@@ -0,0 +1,233 @@
+/**
+ * \file sync/glsync-stat.c
+ * \brief prints live frame statistics of a process running with glsync
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+/*
+ Use:
+ GLSYNC_TELEMETRY=1 LD_PRELOAD=libglsync.so [some opengl app] &
+ glsync-stat <pid> [interval in ms]
+
+ cpu% is the share of fence wait time the render thread spent on a CPU.
+ With GLSYNC_DEPTH=auto, depth controller decisions are reported as they
+ happen.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "telemetry.h"
+
+/**
+ * \brief samples collected during one interval
+ */
+struct stat_samples_s {
+	uint32_t *frame;
+	uint32_t *wait;
+	uint32_t *swap;
+	uint32_t *cpu;
+	uint32_t *gpu;
+	uint32_t *margin;
+	uint32_t *error;
+	uint64_t wait_total;
+	uint64_t wait_cpu_total;
+	uint32_t decision;
+	uint32_t depth;
+	unsigned int count;
+	unsigned int gpu_count;
+};
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * \brief returns given percentile in milliseconds, sorts values
+ */
+static double percentile(uint32_t *val, unsigned int count, unsigned int pct)
+{
+	if (count == 0)
+		return 0.0;
+
+	qsort(val, count, sizeof(uint32_t), cmp_u32);
+	return val[(count - 1) * pct / 100] / 1e6;
+}
+
+/**
+ * \brief copies out published records in [from, to)
+ */
+static void collect(struct glsync_telemetry_s *tm, uint64_t from, uint64_t to,
+		    struct stat_samples_s *out)
+{
+	struct glsync_frame_s rec;
+	const struct glsync_frame_s *src;
+	uint64_t n, seq;
+
+	out->count = 0;
+	out->gpu_count = 0;
+	out->wait_total = 0;
+	out->wait_cpu_total = 0;
+	out->decision = GLSYNC_DEPTH_KEEP;
+	out->depth = 0;
+	for (n = from; n < to; n++) {
+		src = &tm->frame[n & (GLSYNC_TELEMETRY_FRAMES - 1)];
+
+		seq = __atomic_load_n(&src->seq, __ATOMIC_ACQUIRE);
+		if (seq != n + 1)
+			continue; /* not written yet or already overwritten */
+		memcpy(&rec, src, sizeof(rec));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&src->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+
+		/* GPU times arrive late, on whichever record was written next */
+		if (rec.gpu_ns)
+			out->gpu[out->gpu_count++] = rec.gpu_ns;
+
+		if (rec.decision != GLSYNC_DEPTH_KEEP) {
+			out->decision = rec.decision;
+			out->depth = rec.depth;
+		}
+
+		/* first frame of a chain has no previous one to measure against */
+		if (rec.frame_ns == 0)
+			continue;
+
+		out->frame[out->count] = rec.frame_ns;
+		out->wait[out->count] = rec.wait_ns;
+		out->swap[out->count] = rec.swap_ns;
+		out->cpu[out->count] = rec.cpu_ns;
+		out->margin[out->count] = rec.margin_ns;
+		out->error[out->count] = rec.error_ns < 0 ? -rec.error_ns : rec.error_ns;
+		out->wait_total += rec.wait_ns;
+		out->wait_cpu_total += rec.wait_cpu_ns;
+		out->count++;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct glsync_telemetry_s *tm;
+	struct stat_samples_s samples;
+	char name[32];
+	static const char *decisions[] = { "keep", "up", "down", "reverted", "latency ceiling" };
+	uint64_t head, tail, ctx_events = 0, lookups = 0, depth_changes = 0, n;
+	unsigned int interval = 1000;
+	double sec;
+	int fd;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <pid> [interval in ms]\n", argv[0]);
+		return 1;
+	}
+
+	if (argc > 2)
+		interval = atoi(argv[2]);
+	if (interval == 0)
+		interval = 1000;
+
+	snprintf(name, sizeof(name), GLSYNC_TELEMETRY_NAME "%d", atoi(argv[1]));
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		perror(name);
+		return 1;
+	}
+
+	tm = mmap(NULL, sizeof(struct glsync_telemetry_s), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (tm == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	if (__atomic_load_n(&tm->magic, __ATOMIC_ACQUIRE) != GLSYNC_TELEMETRY_MAGIC ||
+	    tm->version != GLSYNC_TELEMETRY_VERSION ||
+	    tm->frame_size != sizeof(struct glsync_frame_s)) {
+		fprintf(stderr, "%s: unsupported telemetry layout\n", name);
+		return 1;
+	}
+
+	samples.frame = calloc(GLSYNC_TELEMETRY_FRAMES, sizeof(uint32_t));
+	samples.wait = calloc(GLSYNC_TELEMETRY_FRAMES, sizeof(uint32_t));
+	samples.swap = calloc(GLSYNC_TELEMETRY_FRAMES, sizeof(uint32_t));
+	samples.cpu = calloc(GLSYNC_TELEMETRY_FRAMES, sizeof(uint32_t));
+	samples.gpu = calloc(GLSYNC_TELEMETRY_FRAMES, sizeof(uint32_t));
+	samples.margin = calloc(GLSYNC_TELEMETRY_FRAMES, sizeof(uint32_t));
+	samples.error = calloc(GLSYNC_TELEMETRY_FRAMES, sizeof(uint32_t));
+
+	printf("%7s %8s | %17s | %17s %6s | %17s | %17s | %17s | %17s\n", "frames", "fps",
+	       "frame p50/p99 ms", "wait p50/p99 ms", "cpu%", "swap p50/p99 ms",
+	       "cpu p50/p99 ms", "gpu p50/p99 ms", "margin/|err| ms");
+
+	tail = __atomic_load_n(&tm->head, __ATOMIC_ACQUIRE);
+	sec = interval / 1000.0;
+	for (;;) {
+		usleep(interval * 1000);
+
+		head = __atomic_load_n(&tm->head, __ATOMIC_ACQUIRE);
+		if (head - tail > GLSYNC_TELEMETRY_FRAMES)
+			tail = head - GLSYNC_TELEMETRY_FRAMES;
+
+		collect(tm, tail, head, &samples);
+
+		printf("%7u %8.1f | %8.2f %8.2f | %8.2f %8.2f %6.1f | %8.2f %8.2f | %8.2f %8.2f | %8.2f %8.2f | %8.2f %8.2f\n",
+		       samples.count, (head - tail) / sec,
+		       percentile(samples.frame, samples.count, 50),
+		       percentile(samples.frame, samples.count, 99),
+		       percentile(samples.wait, samples.count, 50),
+		       percentile(samples.wait, samples.count, 99),
+		       samples.wait_total ? 100.0 * samples.wait_cpu_total / samples.wait_total : 0.0,
+		       percentile(samples.swap, samples.count, 50),
+		       percentile(samples.swap, samples.count, 99),
+		       percentile(samples.cpu, samples.count, 50),
+		       percentile(samples.cpu, samples.count, 99),
+		       percentile(samples.gpu, samples.gpu_count, 50),
+		       percentile(samples.gpu, samples.gpu_count, 99),
+		       percentile(samples.margin, samples.count, 50),
+		       percentile(samples.error, samples.count, 99));
+
+		/* context lifecycle counters, only when they move */
+		n = __atomic_load_n(&tm->ctx_switches, __ATOMIC_RELAXED) +
+		    __atomic_load_n(&tm->ctx_destroyed, __ATOMIC_RELAXED);
+		if (n != ctx_events) {
+			printf("# contexts: %llu switches, %llu destroyed, %llu fences dropped\n",
+			       (unsigned long long) __atomic_load_n(&tm->ctx_switches, __ATOMIC_RELAXED),
+			       (unsigned long long) __atomic_load_n(&tm->ctx_destroyed, __ATOMIC_RELAXED),
+			       (unsigned long long) __atomic_load_n(&tm->fences_dropped, __ATOMIC_RELAXED));
+			ctx_events = n;
+		}
+
+		n = __atomic_load_n(&tm->lookup_hits, __ATOMIC_RELAXED) +
+		    __atomic_load_n(&tm->lookup_misses, __ATOMIC_RELAXED);
+		if (n != lookups) {
+			printf("# lookups: %llu cached, %llu forwarded\n",
+			       (unsigned long long) __atomic_load_n(&tm->lookup_hits, __ATOMIC_RELAXED),
+			       (unsigned long long) __atomic_load_n(&tm->lookup_misses, __ATOMIC_RELAXED));
+			lookups = n;
+		}
+
+		n = __atomic_load_n(&tm->depth_changes, __ATOMIC_RELAXED);
+		if (n != depth_changes) {
+			printf("# depth: %llu changes", (unsigned long long) n);
+			if (samples.decision != GLSYNC_DEPTH_KEEP &&
+			    samples.decision < sizeof(decisions) / sizeof(decisions[0]))
+				printf(", last %s to %u", decisions[samples.decision], samples.depth);
+			printf("\n");
+			depth_changes = n;
+		}
+		fflush(stdout);
+
+		tail = head;
+	}
+
+	return 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * \file sync/glsync.h
+ * \brief frame counters glsync exports to the application
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+#ifndef GLSYNC_H
+#define GLSYNC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  \defgroup glsync glsync
+ *  Functions exported by libglsync.so for engines that want to follow
+ *  GPU progress without touching GL. Since glsync is normally preloaded,
+ *  look them up at runtime instead of linking:
+ *
+ *  uint64_t (*completed)(void) = dlsym(RTLD_DEFAULT, "glsync_frames_completed");
+ *
+ *  NULL means glsync is not loaded. Both are safe to call from any thread.
+ *  \{
+ */
+
+/** bumped when functions are added */
+#define GLSYNC_API_VERSION 1
+
+/**
+ * \brief returns number of frames fenced in swap so far
+ *
+ * Counts every swap glsync placed a fence after, over all contexts and
+ * drawables of the process.
+ */
+uint64_t glsync_frames_submitted(void);
+
+/**
+ * \brief returns number of fenced frames the GPU has finished
+ *
+ * With GLSYNC_WAIT=async this advances as soon as the waiter thread sees
+ * a fence signal, otherwise when a swap has waited for it. The difference
+ * to glsync_frames_submitted() is the number of frames in flight.
+ */
+uint64_t glsync_frames_completed(void);
+
+/** \} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
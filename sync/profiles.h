@@ -0,0 +1,127 @@
+/**
+ * \file sync/profiles.h
+ * \brief per-executable profile database layout
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+#ifndef GLSYNC_PROFILES_H
+#define GLSYNC_PROFILES_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  \defgroup profiles profiles
+ *  glsync-profiles compiles a text profile list into a file glsync maps
+ *  read-only at startup. A header is followed by an open addressing hash
+ *  table of fixed size profiles, linear probing, and by the strings they
+ *  point to. Keys are executable paths or process names. The file ends
+ *  with a NUL byte, so every string offset inside it is terminated.
+ *  \{
+ */
+
+/** "GLSP" */
+#define GLSYNC_PROFILES_MAGIC 0x50534c47
+
+/** layout version, bumped on every change */
+#define GLSYNC_PROFILES_VERSION 1
+
+/** profile field is not set, glsync's default applies */
+#define GLSYNC_PROFILE_UNSET 0xffffffffu
+
+/** depth value selecting the adaptive controller (GLSYNC_DEPTH=auto) */
+#define GLSYNC_PROFILE_DEPTH_AUTO 0xfffffffeu
+
+/** glsync only forwards calls, nothing is paced or hooked */
+#define GLSYNC_PROFILE_OFF 0x1
+
+/** hooks are returned by dlsym() and dlvsym() */
+#define GLSYNC_PROFILE_HOOK_DL 0x1
+
+/** hooks are returned by glXGetProcAddress() and glXGetProcAddressARB() */
+#define GLSYNC_PROFILE_HOOK_GLX 0x2
+
+/** hooks are returned by eglGetProcAddress() */
+#define GLSYNC_PROFILE_HOOK_EGL 0x4
+
+/** GOT slots are patched to hooks (libglsync_got) */
+#define GLSYNC_PROFILE_HOOK_GOT 0x8
+
+/**
+ * \brief settings of one executable
+ */
+struct glsync_profile_s {
+	/** glsync_profile_hash() of key */
+	uint32_t hash;
+
+	/** offset of key from start of file, 0 if bucket is empty */
+	uint32_t key;
+
+	/** GLSYNC_PROFILE_OFF or 0 */
+	uint32_t flags;
+
+	/** GLSYNC_PROFILE_HOOK_* mask or GLSYNC_PROFILE_UNSET */
+	uint32_t hooks;
+
+	/** GLSYNC_DEPTH, GLSYNC_PROFILE_DEPTH_AUTO or GLSYNC_PROFILE_UNSET */
+	uint32_t depth;
+
+	/** GLSYNC_FPS or GLSYNC_PROFILE_UNSET */
+	uint32_t fps;
+
+	/** offset of GLSYNC_MODE keyword from start of file, 0 if unset */
+	uint32_t mode;
+};
+
+/**
+ * \brief database file header
+ */
+struct glsync_profiles_s {
+	/** GLSYNC_PROFILES_MAGIC */
+	uint32_t magic;
+
+	/** GLSYNC_PROFILES_VERSION */
+	uint32_t version;
+
+	/** file size, a truncated file is rejected */
+	uint32_t size;
+
+	/** hash table size, power of two, at least twice the number of profiles */
+	uint32_t buckets;
+
+	/** number of profiles */
+	uint32_t count;
+
+	/** sizeof(struct glsync_profile_s) */
+	uint32_t profile_size;
+
+	/** hash table */
+	struct glsync_profile_s profile[];
+};
+
+/**
+ * \brief key hash, same as DT_GNU_HASH
+ */
+static inline uint32_t glsync_profile_hash(const char *key)
+{
+	const unsigned char *p = (const unsigned char *) key;
+	uint32_t h = 5381;
+
+	while (*p)
+		h = h * 33 + *p++;
+
+	return h;
+}
+
+/** \} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
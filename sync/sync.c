@@ -13,140 +13,3790 @@
 
  And use:
  LD_PRELOAD=/sync.so [some opengl app]
+
+ Built with -DGLSYNC_GOT nothing is exported to override GLX, EGL or
+ dlsym(). Instead the constructor patches the GOT slots of every loaded
+ object that imports a hooked function, and dlopen() is hooked the same
+ way so objects loaded later get patched too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <GL/glx.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <elfhacks.h>
+#include "telemetry.h"
+#include "control.h"
+#include "profiles.h"
+#include "glsync.h"
+
+typedef void (*GLXextFuncPtr)(void);
+
+/** eglGetProcAddress() return type */
+typedef __eglMustCastToProperFunctionPointerType EGLextFuncPtr;
+
+/**
+ * \brief window system API a swap chain belongs to
+ */
+enum sync_api_e {
+	SYNC_API_GLX,
+	SYNC_API_EGL
+};
+
+/**
+ * \brief kind of fence objects a ring holds
+ */
+enum sync_fence_e {
+	/** GL sync objects (ARB_sync) */
+	SYNC_FENCE_GL,
+	/** EGL_KHR_fence_sync objects */
+	SYNC_FENCE_EGL,
+	/** no fences available, only the frame rate limiter paces */
+	SYNC_FENCE_NONE
+};
+
+/**
+ * \brief result of checking a fence
+ */
+enum sync_fence_status_e {
+	SYNC_FENCE_SIGNALED,
+	SYNC_FENCE_TIMEOUT,
+	SYNC_FENCE_FAILED
+};
+
+/**
+ * \brief pacing modes (GLSYNC_MODE)
+ */
+enum sync_mode_e {
+	/** wait for fences, then for the frame rate limiter */
+	SYNC_MODE_FENCE,
+	/** delay next frame start so it completes just before its deadline */
+	SYNC_MODE_JIT,
+	/** jit with deadlines on vblanks predicted from GLX_OML_sync_control */
+	SYNC_MODE_VBLANK
+};
+
+/** GLSYNC_MODE values, indexed by enum sync_mode_e */
+static const char *sync_mode_names[] = { "fence", "jit", "vblank", NULL };
+
+/**
+ * \brief fence wait policies (GLSYNC_WAIT)
+ */
+enum sync_wait_e {
+	/** let the driver block, some drivers spin a whole core doing so */
+	SYNC_WAIT_BLOCK,
+	/** poll with zero timeout, sleep with exponential backoff between polls */
+	SYNC_WAIT_POLL,
+	/** sleep for most of expected fence latency, spin-poll around it */
+	SYNC_WAIT_HYBRID,
+	/** a waiter thread blocks on fences, swap waits only beyond depth */
+	SYNC_WAIT_ASYNC
+};
+
+/** GLSYNC_WAIT values, indexed by enum sync_wait_e */
+static const char *sync_wait_names[] = { "block", "poll", "hybrid", "async", NULL };
+
+/** upper bound for number of frames allowed in flight */
+#define SYNC_MAX_DEPTH 8
+
+/** default upper bound of GLSYNC_DEPTH=auto */
+#define SYNC_DEFAULT_DEPTH_MAX 3
+
+/** frames between depth controller decisions */
+#define SYNC_DEPTH_WINDOW 64
+
+/** frame time change in percent a depth trial must not exceed, or gain going up */
+#define SYNC_DEPTH_BAND 5
+
+/** windows a direction is not tried again after it was first undone */
+#define SYNC_DEPTH_COOLDOWN 16
+
+/** cooldown doubles on every undo in a row, up to this many windows */
+#define SYNC_DEPTH_MAX_COOLDOWN 256
+
+/** GLSYNC_SWAP_INTERVAL value leaving swap interval to the application */
+#define SYNC_SWAP_INTERVAL_APP -1
+
+/** upper bound for GLSYNC_SWAP_INTERVAL */
+#define SYNC_MAX_SWAP_INTERVAL 8
+
+/** fence waits that return this late after a vblank still count as making it */
+#define SYNC_VBLANK_SLACK_NS 250000ull
+
+/** UST further than this from CLOCK_MONOTONIC is taken to be some other clock */
+#define SYNC_MAX_UST_SKEW_NS 10000000000ull
+
+/** number of frames allowed in flight if GLSYNC_DEPTH is not set */
+#define SYNC_DEFAULT_DEPTH 1
+
+/** upper bound for GLSYNC_FPS */
+#define SYNC_MAX_FPS 1000
+
+/** default for GLSYNC_SPIN_US, covers usual clock_nanosleep() overshoot */
+#define SYNC_DEFAULT_SPIN_US 250
+
+/** default for GLSYNC_JIT_MARGIN_US */
+#define SYNC_DEFAULT_JIT_MARGIN_US 500
+
+/** jit mode: recent prediction errors the margin is sized from, power of two */
+#define SYNC_JIT_ERRORS 128
+
+/** first sleep of polling fence wait */
+#define SYNC_POLL_MIN_NS 50000
+
+/** longest sleep of polling fence wait */
+#define SYNC_POLL_MAX_NS 1000000
+
+/** number of frames whose GPU time can be pending readback */
+#define SYNC_MAX_QUERIES (SYNC_MAX_DEPTH + 4)
+
+/** number of KHR_debug messages buffered for the logger thread */
+#define SYNC_DEBUG_MESSAGES 256
+
+/** how often the logger thread prints buffered messages */
+#define SYNC_DEBUG_INTERVAL_NS 100000000ull
+
+/** number of (context, drawable) pairs tracked at once */
+#define SYNC_MAX_CHAINS 16
+
+/** destroyed contexts remembered until every thread has seen them */
+#define SYNC_MAX_DESTROYED 64
+
+/** hook index has 1 << SYNC_HOOK_BITS slots */
+#define SYNC_HOOK_BITS 6
+
+/** hook is returned by dlsym() and dlvsym() */
+#define SYNC_HOOK_DL 0x1
+
+/** hook is returned by glXGetProcAddress() and glXGetProcAddressARB() */
+#define SYNC_HOOK_GLX 0x2
+
+/** hook is returned by eglGetProcAddress() */
+#define SYNC_HOOK_EGL 0x4
+
+/** GOT slots importing the symbol are patched to the hook (GLSYNC_GOT) */
+#define SYNC_HOOK_GOT 0x8
+
+/** entries in lookup cache, power of two */
+#define SYNC_CACHE_ENTRIES 1024
+
+/** entries probed per lookup */
+#define SYNC_CACHE_PROBES 4
+
+/** longer names are not cached */
+#define SYNC_CACHE_NAME 64
+
+/** number of contexts that can have a waiter thread */
+#define SYNC_MAX_WAITERS 8
+
+/**
+ * \brief sync private data struct
+ */
+struct sync_data_s {
+	/** pointer to real dlsym() */
+	void *(*dlsym)(void*, const char*);
+
+	/** pointer to real dlclose() */
+	int (*dlclose)(void *);
+
+	/** pointer to real dlopen() */
+	void *(*dlopen)(const char *, int);
+
+	/** pointer to real dlvsym() */
+	void *(*dlvsym)(void*, const char*, const char*);
+
+	/** SYNC_HOOK_* lookups hooks are returned from, narrowed by profile */
+	unsigned int hooks;
+
+	/** disabled by profile, hooks only forward */
+	int off;
+
+	/** pointer to real glXGetProcAddressARB() */
+	GLXextFuncPtr (*glXGetProcAddressARB)(const GLubyte*);
+
+	/** pointer to real glXSwapBuffers() */
+	void (*glXSwapBuffers)(Display*, GLXDrawable);
+
+	/** pointer to real glXGetCurrentContext() */
+	GLXContext (*glXGetCurrentContext)(void);
+
+	/** pointer to real glXMakeCurrent() */
+	Bool (*glXMakeCurrent)(Display*, GLXDrawable, GLXContext);
+
+	/** pointer to real glXMakeContextCurrent() */
+	Bool (*glXMakeContextCurrent)(Display*, GLXDrawable, GLXDrawable, GLXContext);
+
+	/** pointer to real glXDestroyContext() */
+	void (*glXDestroyContext)(Display*, GLXContext);
+
+	/** GLX and Xlib functions for hidden contexts of waiter threads, may be NULL */
+	int (*glXQueryContext)(Display*, GLXContext, int, int*);
+	GLXFBConfig *(*glXChooseFBConfig)(Display*, int, const int*, int*);
+	GLXContext (*glXCreateNewContext)(Display*, GLXFBConfig, int, GLXContext, Bool);
+	GLXPbuffer (*glXCreatePbuffer)(Display*, GLXFBConfig, const int*);
+	void (*glXDestroyPbuffer)(Display*, GLXPbuffer);
+	Bool (*glXIsDirect)(Display*, GLXContext);
+	void (*XLockDisplay)(Display*);
+	void (*XUnlockDisplay)(Display*);
+	int (*XFree)(void*);
+
+	/** GLX_OML_sync_control, NULL when not supported */
+	PFNGLXGETSYNCVALUESOMLPROC glXGetSyncValuesOML;
+	PFNGLXGETMSCRATEOMLPROC glXGetMscRateOML;
+
+	/** pointers to real swap interval functions, NULL when not supported */
+	PFNGLXSWAPINTERVALEXTPROC glXSwapIntervalEXT;
+	PFNGLXSWAPINTERVALMESAPROC glXSwapIntervalMESA;
+	PFNGLXSWAPINTERVALSGIPROC glXSwapIntervalSGI;
+
+	/** pointer to real eglGetProcAddress() */
+	EGLextFuncPtr (*eglGetProcAddress)(const char*);
+
+	/** pointer to real eglSwapBuffers() */
+	EGLBoolean (*eglSwapBuffers)(EGLDisplay, EGLSurface);
+
+	/** pointer to real eglSwapBuffersWithDamageKHR() */
+	PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC eglSwapBuffersWithDamageKHR;
+
+	/** pointer to real eglSwapBuffersWithDamageEXT() */
+	PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC eglSwapBuffersWithDamageEXT;
+
+	/** EGL entry points used by glsync itself */
+	EGLContext (*eglGetCurrentContext)(void);
+	EGLBoolean (*eglMakeCurrent)(EGLDisplay, EGLSurface, EGLSurface, EGLContext);
+	EGLBoolean (*eglDestroyContext)(EGLDisplay, EGLContext);
+	EGLenum (*eglQueryAPI)(void);
+	const char *(*eglQueryString)(EGLDisplay, EGLint);
+
+	/** EGL functions for hidden contexts of waiter threads, may be NULL */
+	EGLBoolean (*eglQueryContext)(EGLDisplay, EGLContext, EGLint, EGLint*);
+	EGLBoolean (*eglChooseConfig)(EGLDisplay, const EGLint*, EGLConfig*, EGLint, EGLint*);
+	EGLContext (*eglCreateContext)(EGLDisplay, EGLConfig, EGLContext, const EGLint*);
+	EGLBoolean (*eglBindAPI)(EGLenum);
+	EGLBoolean (*eglReleaseThread)(void);
+	PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR;
+	PFNEGLCLIENTWAITSYNCKHRPROC eglClientWaitSyncKHR;
+	PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR;
+
+	/** GL entry points below have been looked up */
+	int gl_resolved;
+
+	/** GL entry points used by glsync itself */
+	void (*glEnable)(GLenum);
+	void (*glGetPointerv)(GLenum, void **);
+	PFNGLDEBUGMESSAGECALLBACKPROC glDebugMessageCallback;
+	PFNGLFENCESYNCPROC glFenceSync;
+	PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+	PFNGLDELETESYNCPROC glDeleteSync;
+	PFNGLGENQUERIESPROC glGenQueries;
+	PFNGLDELETEQUERIESPROC glDeleteQueries;
+	PFNGLQUERYCOUNTERPROC glQueryCounter;
+	PFNGLGETQUERYOBJECTIVPROC glGetQueryObjectiv;
+	PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v;
+
+	/** measure GPU time with timer queries (GLSYNC_GPUTIME) */
+	int gputime;
+
+	/** log KHR_debug messages (GLSYNC_DEBUG) */
+	int debug;
+
+	/** number of frames allowed in flight (GLSYNC_DEPTH), initial one if auto */
+	unsigned int depth;
+
+	/** GLSYNC_DEPTH=auto, chains adjust depth between depth_min and depth_max */
+	int depth_auto;
+	unsigned int depth_min, depth_max;
+
+	/** latency ceiling of auto depth in ns (GLSYNC_LATENCY_US), 0 if none */
+	uint64_t latency;
+
+	/** pacing mode (GLSYNC_MODE) */
+	enum sync_mode_e mode;
+
+	/** fence wait policy (GLSYNC_WAIT) */
+	enum sync_wait_e wait;
+
+	/** smallest safety margin of jit mode in ns */
+	uint64_t jit_margin;
+
+	/** frame interval of the frame rate limiter in ns, 0 if disabled */
+	uint64_t frame_interval __attribute__ ((aligned (8)));
+
+	/** time before a deadline spent spinning instead of sleeping, in ns */
+	uint64_t spin;
+
+	/** forced swap interval (GLSYNC_SWAP_INTERVAL), SYNC_SWAP_INTERVAL_APP if none */
+	int swap_interval;
+
+	/** swap interval in effect, as last set by the application or forced */
+	int interval;
+
+	/** telemetry segment while telemetry is on, NULL otherwise */
+	struct glsync_telemetry_s *telemetry;
+
+	/** telemetry segment, stays mapped once created so it can be turned back on */
+	struct glsync_telemetry_s *telemetry_segment;
+
+	/** shared memory name of telemetry segment */
+	char telemetry_name[32];
+
+	/** frames fenced and frames whose fence signaled, see glsync.h */
+	uint64_t frames_submitted;
+	uint64_t frames_completed;
+};
+
+/**
+ * \brief ring of fences for frames that are still in flight
+ *
+ * Holds at most depth + 1 fences, the extra slot is for the frame that was
+ * just submitted before the oldest one is retired.
+ */
+struct sync_ring_s {
+	/** kind of fences in this ring */
+	enum sync_fence_e kind;
+
+	/** waiter thread owning the fences (GLSYNC_WAIT=async), NULL if none */
+	struct sync_waiter_s *waiter;
+
+	/** waiter sequence number of each fence */
+	uint32_t seq[SYNC_MAX_DEPTH + 1];
+
+	/** display of SYNC_FENCE_EGL fences */
+	EGLDisplay dpy;
+
+	/** fence objects, oldest at head */
+	void *fence[SYNC_MAX_DEPTH + 1];
+
+	/** time each fence was created */
+	uint64_t created[SYNC_MAX_DEPTH + 1];
+
+	/** moving average of time from fence creation to signal */
+	uint64_t latency;
+
+	/** a wait failed and was reported */
+	int failed;
+
+	/** index of oldest fence */
+	unsigned int head;
+
+	/** number of fences in ring */
+	unsigned int count;
+};
+
+/**
+ * \brief GL_TIMESTAMP query pairs bracketing frames
+ *
+ * Pair at head + count is the one being recorded if open is set, pairs
+ * in [head, head + count) wait for their results.
+ */
+struct sync_queries_s {
+	/** query issued when the frame started */
+	GLuint start[SYNC_MAX_QUERIES];
+
+	/** query issued when the frame was swapped */
+	GLuint end[SYNC_MAX_QUERIES];
+
+	/** chain frame number each pair belongs to */
+	uint64_t frame[SYNC_MAX_QUERIES];
+
+	/** oldest pair waiting for result */
+	unsigned int head;
+
+	/** number of pairs waiting for result */
+	unsigned int count;
+
+	/** start query of next pair has been issued */
+	int open;
+
+	/** GPU time of most recently read back frame */
+	uint64_t gpu_time;
+
+	/** chain frame number gpu_time belongs to */
+	uint64_t gpu_frame;
+
+	/** gpu_frame last put into telemetry */
+	uint64_t reported;
+};
+
+/**
+ * \brief key identifying one swap chain
+ */
+struct sync_chain_key_s {
+	/** context the fences were created in (GLXContext or EGLContext) */
+	void *ctx;
+
+	/** drawable being swapped (GLXDrawable or EGLSurface) */
+	unsigned long drawable;
+};
+
+/**
+ * \brief depth controller state of one chain (GLSYNC_DEPTH=auto)
+ *
+ * Averages are exponential with weight 1/8 per frame. Trials are judged on
+ * plain means over a window, which are steadier.
+ */
+struct sync_depth_s {
+	/** controller runs on this chain, depth is fixed otherwise */
+	int enabled;
+
+	/** frames allowed in flight now */
+	unsigned int depth;
+
+	/** moving average of time between swaps */
+	uint64_t frame_avg;
+
+	/** moving average of application CPU time between swaps */
+	uint64_t cpu_avg;
+
+	/** moving average of time stalled in swap, fence waits and driver throttling */
+	uint64_t wait_avg;
+
+	/** moving average of time from swap entry to GPU completion */
+	uint64_t gpu_avg;
+
+	/** frames until next decision */
+	unsigned int countdown;
+
+	/** sum of time between swaps in current window */
+	uint64_t window_sum;
+
+	/** GLSYNC_DEPTH_UP or GLSYNC_DEPTH_DOWN while trying, GLSYNC_DEPTH_KEEP otherwise */
+	enum glsync_depth_decision_e trial;
+
+	/** mean time between swaps over the window before trial */
+	uint64_t baseline;
+
+	/** windows until up and down may be tried again */
+	unsigned int cooldown_up, cooldown_down;
+
+	/** cooldown after next undo of up and down */
+	unsigned int backoff_up, backoff_down;
+};
+
+/**
+ * \brief state of one swap chain
+ */
+struct sync_chain_s {
+	/** fences of frames in flight */
+	struct sync_ring_s ring;
+
+	/** GPU time measurement */
+	struct sync_queries_s queries;
+
+	/** timer queries can be used in this chain's context */
+	int gputime;
+
+	/** number of swaps of this chain */
+	uint64_t frames;
+
+	/** time of last swap entry, 0 before first swap */
+	uint64_t last_entry;
+
+	/** time last swap returned to application */
+	uint64_t last_exit;
+
+	/** frame rate limiter deadline for next swap, 0 before first swap */
+	uint64_t deadline;
+
+	/** jit mode: moving average of application CPU plus fence wait time */
+	uint64_t jit_cost;
+
+	/** jit mode: how much later than predicted recent frames completed, 0 if earlier */
+	uint32_t jit_over[SYNC_JIT_ERRORS];
+
+	/** jit mode: completion time predicted for the frame now being rendered */
+	uint64_t jit_finish;
+
+	/** vblank mode: refresh period in ns, 0 if vblanks can't be predicted */
+	uint64_t refresh;
+
+	/** vblank mode: jit margin floor raised by missed vblanks */
+	uint64_t vblank_margin;
+
+	/** vblank mode: swap buffer count at the last swap */
+	int64_t vblank_sbc;
+
+	/** vblank mode: frames swapped but not shown at the last swap */
+	int64_t vblank_pending;
+
+	/** adaptive depth */
+	struct sync_depth_s depth;
+
+	/** sync_control.generation the settings of this chain date from */
+	unsigned int generation;
+};
+
+/**
+ * \brief per swap chain fence tracking
+ *
+ * Keys are kept apart from the chain state so a lookup scans only a few
+ * cache lines. Slot with NULL ctx is free.
+ */
+struct sync_chains_s {
+	/** chain keys */
+	struct sync_chain_key_s key[SYNC_MAX_CHAINS];
+
+	/** swap counter value of last use, for eviction */
+	unsigned long last_use[SYNC_MAX_CHAINS];
+
+	/** state of each chain */
+	struct sync_chain_s chain[SYNC_MAX_CHAINS];
+
+	/** slot that matched last time */
+	unsigned int last;
+
+	/** number of swaps so far */
+	unsigned long swaps;
+
+	/** sync_destroyed.epoch when destroyed contexts were last checked */
+	unsigned long epoch;
+};
+
+/**
+ * \brief fence waiter thread of one context (GLSYNC_WAIT=async)
+ *
+ * Swaps queue fences here and the thread waits for them in order, in a
+ * hidden context shared with the application's one. EGL fences are
+ * waited for without any context. Each retired fence bumps completed,
+ * which swaps that exceed their depth sleep on as a futex.
+ */
+struct sync_waiter_s {
+	/** application context served, NULL if slot is free */
+	void *ctx;
+
+	/** API and display of ctx */
+	enum sync_api_e api;
+	void *dpy;
+
+	/** eglQueryAPI() of ctx */
+	EGLenum egl_api;
+
+	/** hidden shared context and its pbuffer, NULL for EGL fences */
+	void *hidden;
+	GLXPbuffer pbuffer;
+
+	/** thread could not start, swaps wait for fences themselves */
+	int failed;
+
+	/** thread has started, or failed to */
+	int started;
+
+	/** thread should exit once queue is empty */
+	int quit;
+
+	pthread_t thread;
+
+	/** guards ring, queued, started and quit */
+	pthread_mutex_t mutex;
+
+	/** signaled when a fence is queued or quit is set */
+	pthread_cond_t queue_cond;
+
+	/** signaled when a fence is retired or the thread has started */
+	pthread_cond_t space_cond;
+
+	/** queued fences, kind and dpy as in the chains that queue them */
+	struct sync_ring_s ring;
+
+	/** number of fences queued so far */
+	uint32_t queued;
+
+	/** number of fences retired so far, futex word */
+	uint32_t completed;
+
+	/** swaps sleeping on completed */
+	uint32_t sleepers;
+};
+
+/**
+ * \brief waiter threads, one per context that swapped in async mode
+ */
+struct sync_waiters_s {
+	/** guards slot allocation */
+	pthread_mutex_t mutex;
+
+	struct sync_waiter_s waiter[SYNC_MAX_WAITERS];
+};
+
+/**
+ * \brief runtime control (GLSYNC_CONTROL)
+ */
+struct sync_control_s {
+	/** held by the swap applying a request */
+	pthread_mutex_t mutex;
+
+	/** control block, NULL unless GLSYNC_CONTROL is set */
+	struct glsync_control_s *block;
+
+	/** request_seq of the last request handled */
+	uint32_t seq;
+
+	/** bumped after settings changed, chains catch up at their next swap */
+	unsigned int generation;
+
+	/** shared memory name of control block */
+	char name[32];
+};
+
+/**
+ * \brief intercepted function
+ */
+struct sync_hook_s {
+	/** symbol name */
+	const char *name;
+
+	/** our replacement */
+	void *func;
+
+	/** SYNC_HOOK_* lookups the replacement is returned from */
+	unsigned int flags;
+
+	/** real function of an optional extension, get-proc-address hides hook while NULL */
+	void **real;
+};
+
+/**
+ * \brief one cached lookup
+ *
+ * Written under sync_cache.mutex, read without locking: seq is odd while
+ * the entry is being written, readers check it before and after.
+ */
+struct sync_cache_entry_s {
+	/** write sequence, odd while being written */
+	uint32_t seq;
+
+	/** hash of name */
+	uint32_t hash;
+
+	/** sync_cache.generation before the lookup was made */
+	unsigned long generation;
+
+	/** dlsym() handle, or pointer to the real loader for get-proc-address lookups */
+	void *handle;
+
+	/** what the real lookup returned */
+	void *result;
+
+	/** symbol name */
+	char name[SYNC_CACHE_NAME];
+};
+
+/**
+ * \brief cache of lookups forwarded to the real dlsym() and GL loaders
+ *
+ * Only successful lookups are cached. dlclose() bumps generation, which
+ * invalidates every entry at once, since an RTLD_DEFAULT result may come
+ * from any library.
+ */
+struct sync_cache_s {
+	/** serializes writers */
+	pthread_mutex_t mutex;
+
+	/** bumped by every dlclose() */
+	unsigned long generation;
+
+	/** open addressing table, probed linearly */
+	struct sync_cache_entry_s entry[SYNC_CACHE_ENTRIES];
+};
+
+/**
+ * \brief recently destroyed contexts
+ *
+ * Chains live in per-thread tables, so a context destroyed from one thread
+ * may still have chains in others. Every thread compares epoch to what it
+ * saw last before using its table and forgets chains of contexts destroyed
+ * since. A context address reused by a new context is thus never mistaken
+ * for the old one.
+ */
+struct sync_destroyed_s {
+	/** serializes writers and readers that fell behind */
+	pthread_mutex_t mutex;
+
+	/** number of contexts destroyed so far */
+	unsigned long epoch;
+
+	/** destroyed contexts, indexed by epoch % SYNC_MAX_DESTROYED */
+	void *ctx[SYNC_MAX_DESTROYED];
+};
+
+/**
+ * \brief swap functions glsync wraps
+ */
+enum sync_swap_func_e {
+	SYNC_SWAP_GLX,
+	SYNC_SWAP_EGL,
+	SYNC_SWAP_EGL_DAMAGE_KHR,
+	SYNC_SWAP_EGL_DAMAGE_EXT
+};
+
+/**
+ * \brief arguments of an intercepted swap
+ */
+struct sync_swap_s {
+	/** function that was called */
+	enum sync_swap_func_e func;
+
+	/** Display or EGLDisplay */
+	void *dpy;
+
+	/** GLXDrawable or EGLSurface */
+	unsigned long drawable;
+
+	/** damage rectangles of eglSwapBuffersWithDamage*() */
+	const EGLint *rects;
+
+	/** number of damage rectangles */
+	EGLint nrects;
+};
+
+/**
+ * \brief one buffered KHR_debug message
+ */
+struct sync_debug_msg_s {
+	/** message index + 1 once complete */
+	uint64_t seq;
+
+	/** formatted message */
+	char text[248];
+};
+
+/**
+ * \brief KHR_debug message buffer
+ *
+ * Writers claim [head] only while it is less than SYNC_DEBUG_MESSAGES
+ * ahead of tail, the logger thread advances tail.
+ */
+struct sync_debug_s {
+	/** messages claimed by writers */
+	uint64_t head;
+
+	/** messages printed */
+	uint64_t tail;
+
+	/** messages lost because buffer was full */
+	uint64_t dropped;
+
+	/** message ring */
+	struct sync_debug_msg_s msg[SYNC_DEBUG_MESSAGES];
+};
+
+/** KHR_debug messages waiting to be printed */
+static struct sync_debug_s sync_debug;
+
+/** sync data, filled by init_sync_data() and init_sync_gl() */
+static struct sync_data_s sync_data;
+
+/** guards init_sync_data() */
+static pthread_once_t sync_once = PTHREAD_ONCE_INIT;
+
+/** guards init_sync_gl() */
+static pthread_once_t sync_gl_once = PTHREAD_ONCE_INIT;
+
+/** guards init_sync_egl() */
+static pthread_once_t sync_egl_once = PTHREAD_ONCE_INIT;
+
+/** guards init_sync_swap() */
+static pthread_once_t sync_swap_once = PTHREAD_ONCE_INIT;
+
+/** forwarded lookups, generation starts at 1 so zeroed entries are stale */
+static struct sync_cache_s sync_cache = { PTHREAD_MUTEX_INITIALIZER, 1, { { 0 } } };
+
+/** contexts destroyed recently */
+static struct sync_destroyed_s sync_destroyed = { PTHREAD_MUTEX_INITIALIZER, 0, { NULL } };
+
+/** waiter threads */
+static struct sync_waiters_s sync_waiters = { PTHREAD_MUTEX_INITIALIZER };
+
+/** runtime control */
+static struct sync_control_s sync_control = { PTHREAD_MUTEX_INITIALIZER };
+
+/** set while init_sync_gl() runs on this thread */
+static __thread int sync_gl_initializing;
+
+/** swap chains of this thread, a context is current in one thread only */
+static __thread struct sync_chains_s sync_chains;
+
+/**
+ * \brief reads unsigned integer from environment
+ * \param name variable name
+ * \param def value used if variable is not set
+ * \param max largest accepted value, larger ones are clamped
+ */
+static unsigned int sync_getenv_uint(const char *name, unsigned int def, unsigned int max)
+{
+	const char *str = getenv(name);
+	unsigned long val;
+	char *end;
+
+	if (str == NULL || *str == '\0')
+		return def;
+
+	val = strtoul(str, &end, 10);
+	if (*end != '\0') {
+		fprintf(stderr, "glsync: ignoring invalid %s=%s\n", name, str);
+		return def;
+	}
+
+	if (val > max) {
+		fprintf(stderr, "glsync: %s=%s clamped to %u\n", name, str, max);
+		return max;
+	}
+
+	return val;
+}
+
+/**
+ * \brief reads signed integer from environment
+ * \param name variable name
+ * \param def value used if variable is not set
+ * \param min smallest accepted value, smaller ones are clamped
+ * \param max largest accepted value, larger ones are clamped
+ */
+static int sync_getenv_int(const char *name, int def, int min, int max)
+{
+	const char *str = getenv(name);
+	long val;
+	char *end;
+
+	if (str == NULL || *str == '\0')
+		return def;
+
+	val = strtol(str, &end, 10);
+	if (*end != '\0') {
+		fprintf(stderr, "glsync: ignoring invalid %s=%s\n", name, str);
+		return def;
+	}
+
+	if (val < min) {
+		fprintf(stderr, "glsync: %s=%s clamped to %d\n", name, str, min);
+		return min;
+	}
+
+	if (val > max) {
+		fprintf(stderr, "glsync: %s=%s clamped to %d\n", name, str, max);
+		return max;
+	}
+
+	return val;
+}
+
+/**
+ * \brief current CLOCK_MONOTONIC time in nanoseconds
+ */
+static inline uint64_t sync_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * \brief busy wait hint
+ */
+static inline void sync_cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#endif
+}
+
+/**
+ * \brief reads one of given keywords from environment
+ * \param name variable name
+ * \param choices NULL terminated keywords
+ * \param def index used if variable is not set or is invalid
+ * \return index of keyword
+ */
+static unsigned int sync_getenv_choice(const char *name, const char **choices, unsigned int def)
+{
+	const char *str = getenv(name);
+	unsigned int i;
+
+	if (str == NULL || *str == '\0')
+		return def;
+
+	for (i = 0; choices[i]; i++) {
+		if (!strcmp(str, choices[i]))
+			return i;
+	}
+
+	fprintf(stderr, "glsync: ignoring invalid %s=%s\n", name, str);
+	return def;
+}
+
+/**
+ * \brief CPU time consumed by calling thread in nanoseconds
+ */
+static inline uint64_t sync_thread_cputime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * \brief sleeps until given CLOCK_MONOTONIC time
+ */
+static void sync_sleep_until(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000ull;
+	ts.tv_nsec = t % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+/**
+ * \brief waits until given CLOCK_MONOTONIC time
+ *
+ * Sleeps until sync_data.spin before the deadline and spins the rest,
+ * sleeping alone overshoots by the timer slack and scheduling latency.
+ */
+static void sync_wait_until(uint64_t deadline)
+{
+	if (sync_now() + sync_data.spin < deadline)
+		sync_sleep_until(deadline - sync_data.spin);
+
+	while (sync_now() < deadline)
+		sync_cpu_relax();
+}
+
+/** dl*() functions glsync forwards to, hashed at compile time */
+static eh_symref_t sync_dl_refs[] = {
+	EH_SYMREF("dlsym"),
+	EH_SYMREF("dlvsym"),
+	EH_SYMREF("dlclose"),
+	EH_SYMREF("dlopen")
+};
+
+#define SYNC_DL_REFS (sizeof(sync_dl_refs) / sizeof(sync_dl_refs[0]))
+
+/**
+ * \brief finds libdl functions with elfhacks
+ *
+ * glibc 2.34 moved the dl*() functions into libc, libdl is just a stub
+ * that may or may not be loaded, so libc is searched for whatever libdl
+ * did not have.
+ * \param to resolved addresses in sync_dl_refs order, NULL if not found
+ * \return 0 on success otherwise a positive error code
+ */
+static int sync_find_dl_syms(void **to)
+{
+	void *libc[SYNC_DL_REFS];
+	unsigned int i;
+	eh_obj_t obj;
+	int ret;
+
+	memset(to, 0, SYNC_DL_REFS * sizeof(void *));
+	if (!eh_find_obj(&obj, "*libdl.so*")) {
+		ret = eh_find_syms(&obj, sync_dl_refs, SYNC_DL_REFS, to);
+		eh_destroy_obj(&obj);
+		if (!ret)
+			return 0;
+	}
+
+	if ((ret = eh_find_obj(&obj, "*libc.so*")))
+		return ret;
+
+	eh_find_syms(&obj, sync_dl_refs, SYNC_DL_REFS, libc);
+	eh_destroy_obj(&obj);
+
+	for (i = 0; i < SYNC_DL_REFS; i++) {
+		if (!to[i])
+			to[i] = libc[i];
+		if (!to[i])
+			ret = EAGAIN;
+	}
+
+	return ret;
+}
+
+/**
+ * \brief finds key in mapped profile database
+ * \return profile or NULL
+ */
+static const struct glsync_profile_s *sync_profile_probe(const struct glsync_profiles_s *db, const char *key)
+{
+	const struct glsync_profile_s *p;
+	uint32_t hash = glsync_profile_hash(key);
+	unsigned int i;
+
+	for (i = 0; i < db->buckets; i++) {
+		p = &db->profile[(hash + i) & (db->buckets - 1)];
+		if (p->key == 0)
+			return NULL;
+		if (p->hash == hash && p->key < db->size && !strcmp((const char *) db + p->key, key))
+			return p;
+	}
+
+	return NULL;
+}
+
+/**
+ * \brief maps profile database, NULL if there is none or it is not valid
+ *
+ * GLSYNC_PROFILES names the database, empty disables profiles, default is
+ * glsync/profiles.db under $XDG_CONFIG_HOME or ~/.config.
+ * \param size set to mapping size
+ */
+static const struct glsync_profiles_s *sync_profiles_map(size_t *size)
+{
+	const struct glsync_profiles_s *db;
+	const char *path = getenv("GLSYNC_PROFILES"), *dir;
+	char buf[PATH_MAX];
+	struct stat st;
+	int fd;
+
+	if (path == NULL) {
+		if ((dir = getenv("XDG_CONFIG_HOME")) && *dir)
+			snprintf(buf, sizeof(buf), "%s/glsync/profiles.db", dir);
+		else if ((dir = getenv("HOME")) && *dir)
+			snprintf(buf, sizeof(buf), "%s/.config/glsync/profiles.db", dir);
+		else
+			return NULL;
+		path = buf;
+	} else if (*path == '\0')
+		return NULL;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) || st.st_size < (off_t) sizeof(struct glsync_profiles_s) ||
+	    st.st_size > UINT32_MAX) {
+		close(fd);
+		fprintf(stderr, "glsync: %s is not a profile database\n", path);
+		return NULL;
+	}
+
+	*size = st.st_size;
+	db = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (db == MAP_FAILED)
+		return NULL;
+
+	/* ends with NUL, so keys are terminated within the mapping */
+	if (db->magic != GLSYNC_PROFILES_MAGIC || db->version != GLSYNC_PROFILES_VERSION ||
+	    db->profile_size != sizeof(struct glsync_profile_s) || db->size != *size ||
+	    db->buckets == 0 || (db->buckets & (db->buckets - 1)) ||
+	    db->buckets > (*size - sizeof(struct glsync_profiles_s)) / sizeof(struct glsync_profile_s) ||
+	    ((const char *) db)[*size - 1] != '\0') {
+		fprintf(stderr, "glsync: %s is not a profile database, rebuild it with glsync-profiles\n",
+			path);
+		munmap((void *) db, *size);
+		return NULL;
+	}
+
+	return db;
+}
+
+/**
+ * \brief looks up profile of this process
+ *
+ * Tries the executable path, its base name and the process name, in that
+ * order. Unset fields are left GLSYNC_PROFILE_UNSET.
+ * \param out profile found, mode is an index into sync_mode_names
+ */
+static void sync_profile_find(struct glsync_profile_s *out)
+{
+	const struct glsync_profiles_s *db;
+	const struct glsync_profile_s *p = NULL;
+	char exe[PATH_MAX], comm[32];
+	const char *key[3], *match = NULL;
+	unsigned int nkeys = 0, i;
+	size_t size;
+	ssize_t len;
+	int fd;
+
+	memset(out, 0, sizeof(struct glsync_profile_s));
+	out->hooks = out->depth = out->fps = out->mode = GLSYNC_PROFILE_UNSET;
+
+	db = sync_profiles_map(&size);
+	if (db == NULL)
+		return;
+
+	len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	if (len > 0) {
+		exe[len] = '\0';
+		key[nkeys++] = exe;
+		if (strrchr(exe, '/'))
+			key[nkeys++] = strrchr(exe, '/') + 1;
+	}
+
+	fd = open("/proc/self/comm", O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		len = read(fd, comm, sizeof(comm) - 1);
+		close(fd);
+		if (len > 0 && comm[len - 1] == '\n')
+			len--;
+		if (len > 0) {
+			comm[len] = '\0';
+			key[nkeys++] = comm;
+		}
+	}
+
+	for (i = 0; i < nkeys && p == NULL; i++) {
+		p = sync_profile_probe(db, key[i]);
+		match = key[i];
+	}
+
+	if (p) {
+		out->flags = p->flags;
+		out->hooks = p->hooks;
+		out->depth = p->depth;
+		out->fps = p->fps;
+		for (i = 0; p->mode && p->mode < size && sync_mode_names[i]; i++) {
+			if (!strcmp((const char *) db + p->mode, sync_mode_names[i]))
+				out->mode = i;
+		}
+
+		fprintf(stderr, "glsync: %s by profile %s\n",
+			p->flags & GLSYNC_PROFILE_OFF ? "disabled" : "configured", match);
+	}
+
+	munmap((void *) db, size);
+}
+
+/**
+ * \brief selects the adaptive depth controller, starting at the default depth
+ */
+static void sync_depth_auto(void)
+{
+	unsigned int depth = SYNC_DEFAULT_DEPTH;
+
+	if (depth < sync_data.depth_min)
+		depth = sync_data.depth_min;
+	if (depth > sync_data.depth_max)
+		depth = sync_data.depth_max;
+
+	__atomic_store_n(&sync_data.depth, depth, __ATOMIC_RELAXED);
+	__atomic_store_n(&sync_data.depth_auto, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief initializes sync_data
+ *
+ * Resolves only what the dlsym() wrappers need. Other libraries may call
+ * dlsym() from their constructors before ours has run, so this must not
+ * dlopen() anything. Runs exactly once, through sync_init().
+ */
+static void init_sync_data(void)
+{
+	struct glsync_profile_s profile;
+	void *dl[SYNC_DL_REFS];
+	unsigned int fps, i;
+	const char *str;
+
+	/* profile values stand in for defaults, environment still wins */
+	sync_profile_find(&profile);
+	sync_data.hooks = SYNC_HOOK_DL | SYNC_HOOK_GLX | SYNC_HOOK_EGL | SYNC_HOOK_GOT;
+	if (profile.flags & GLSYNC_PROFILE_OFF) {
+		sync_data.off = 1;
+		sync_data.hooks = 0;
+	} else if (profile.hooks != GLSYNC_PROFILE_UNSET) {
+		sync_data.hooks = (profile.hooks & GLSYNC_PROFILE_HOOK_DL ? SYNC_HOOK_DL : 0) |
+				  (profile.hooks & GLSYNC_PROFILE_HOOK_GLX ? SYNC_HOOK_GLX : 0) |
+				  (profile.hooks & GLSYNC_PROFILE_HOOK_EGL ? SYNC_HOOK_EGL : 0) |
+				  (profile.hooks & GLSYNC_PROFILE_HOOK_GOT ? SYNC_HOOK_GOT : 0);
+	}
+
+	/* read even without auto, GLSYNC_CONTROL may switch to it later */
+	sync_data.depth_min = sync_getenv_uint("GLSYNC_DEPTH_MIN", 0, SYNC_MAX_DEPTH);
+	sync_data.depth_max = sync_getenv_uint("GLSYNC_DEPTH_MAX", SYNC_DEFAULT_DEPTH_MAX, SYNC_MAX_DEPTH);
+	if (sync_data.depth_min > sync_data.depth_max)
+		sync_data.depth_min = sync_data.depth_max;
+	sync_data.latency = sync_getenv_uint("GLSYNC_LATENCY_US", 0, 1000000) * 1000ull;
+
+	str = getenv("GLSYNC_DEPTH");
+	if (str && *str ? !strcmp(str, "auto") : profile.depth == GLSYNC_PROFILE_DEPTH_AUTO)
+		sync_depth_auto();
+	else
+		sync_data.depth = sync_getenv_uint("GLSYNC_DEPTH", profile.depth <= SYNC_MAX_DEPTH ?
+						   profile.depth : SYNC_DEFAULT_DEPTH, SYNC_MAX_DEPTH);
+
+	fps = sync_getenv_uint("GLSYNC_FPS", profile.fps <= SYNC_MAX_FPS ? profile.fps : 0, SYNC_MAX_FPS);
+	if (fps)
+		sync_data.frame_interval = 1000000000ull / fps;
+	sync_data.spin = sync_getenv_uint("GLSYNC_SPIN_US", SYNC_DEFAULT_SPIN_US, 1000000) * 1000ull;
+
+	sync_data.mode = sync_getenv_choice("GLSYNC_MODE", sync_mode_names, profile.mode != GLSYNC_PROFILE_UNSET ?
+					    profile.mode : SYNC_MODE_FENCE);
+	sync_data.wait = sync_getenv_choice("GLSYNC_WAIT", sync_wait_names, SYNC_WAIT_BLOCK);
+	sync_data.gputime = sync_getenv_uint("GLSYNC_GPUTIME", 0, 1);
+	sync_data.debug = sync_getenv_uint("GLSYNC_DEBUG", 0, 1);
+	sync_data.jit_margin = sync_getenv_uint("GLSYNC_JIT_MARGIN_US", SYNC_DEFAULT_JIT_MARGIN_US, 1000000) * 1000ull;
+	sync_data.swap_interval = sync_getenv_int("GLSYNC_SWAP_INTERVAL", SYNC_SWAP_INTERVAL_APP,
+						  SYNC_SWAP_INTERVAL_APP, SYNC_MAX_SWAP_INTERVAL);
+	/* drivers default to vsync */
+	sync_data.interval = sync_data.swap_interval == SYNC_SWAP_INTERVAL_APP ? 1 : sync_data.swap_interval;
+	if (sync_data.mode == SYNC_MODE_JIT && !sync_data.frame_interval)
+		fprintf(stderr, "glsync: jit mode needs a deadline, set GLSYNC_FPS\n");
+
+	/* get dl*() using elfhacks */
+	if (sync_find_dl_syms(dl)) {
+		for (i = 0; i < SYNC_DL_REFS; i++) {
+			if (!dl[i])
+				fprintf(stderr, "can't get %s()\n", sync_dl_refs[i].name);
+		}
+		exit(1);
+	}
+
+	sync_data.dlsym = dl[0];
+	sync_data.dlvsym = dl[1];
+	sync_data.dlclose = dl[2];
+	sync_data.dlopen = dl[3];
+}
+
+/**
+ * \brief looks up GL entry points used by glsync
+ *
+ * Called with whichever of glXGetProcAddressARB() and eglGetProcAddress()
+ * is available first, does nothing after that.
+ * \param get_proc GL loader
+ */
+static void sync_resolve_gl(void *(*get_proc)(const char *))
+{
+	if (sync_data.gl_resolved)
+		return;
+
+	/*
+	 The application may have loaded libGL with RTLD_LOCAL, or not at
+	 all when it uses EGL, so GL calls made by glsync go through pointers
+	 rather than through the linker.
+	*/
+#define SYNC_GL_PROC(name) \
+	sync_data.name = get_proc(#name)
+
+	SYNC_GL_PROC(glEnable);
+	SYNC_GL_PROC(glGetPointerv);
+	SYNC_GL_PROC(glDebugMessageCallback);
+	SYNC_GL_PROC(glFenceSync);
+	SYNC_GL_PROC(glClientWaitSync);
+	SYNC_GL_PROC(glDeleteSync);
+	SYNC_GL_PROC(glGenQueries);
+	SYNC_GL_PROC(glDeleteQueries);
+	SYNC_GL_PROC(glQueryCounter);
+	SYNC_GL_PROC(glGetQueryObjectiv);
+	SYNC_GL_PROC(glGetQueryObjectui64v);
+
+#undef SYNC_GL_PROC
+
+	/* ARB_debug_output is the same API for our purposes */
+	if (sync_data.glDebugMessageCallback == NULL)
+		sync_data.glDebugMessageCallback = get_proc("glDebugMessageCallbackARB");
+
+	/* chains fall back to SYNC_FENCE_NONE */
+	if (!sync_data.glFenceSync ||
+	    !sync_data.glClientWaitSync || !sync_data.glDeleteSync) {
+		fprintf(stderr, "glsync: no GL sync objects\n");
+		sync_data.glFenceSync = NULL;
+	}
+
+	if (sync_data.gputime &&
+	    (!sync_data.glGenQueries || !sync_data.glDeleteQueries ||
+	     !sync_data.glQueryCounter || !sync_data.glGetQueryObjectiv ||
+	     !sync_data.glGetQueryObjectui64v)) {
+		fprintf(stderr, "glsync: no timer queries, GLSYNC_GPUTIME ignored\n");
+		sync_data.gputime = 0;
+	}
+
+	if (sync_data.debug &&
+	    (!sync_data.glEnable || !sync_data.glGetPointerv || !sync_data.glDebugMessageCallback)) {
+		fprintf(stderr, "glsync: no KHR_debug, GLSYNC_DEBUG ignored\n");
+		sync_data.debug = 0;
+	}
+
+	sync_data.gl_resolved = 1;
+
+	/* the profile said so already */
+	if (sync_data.off)
+		return;
+
+	fprintf(stderr, "GLXFLUSH swap buf, %s mode, %s wait, ",
+		sync_mode_names[sync_data.mode], sync_wait_names[sync_data.wait]);
+	if (sync_data.depth_auto)
+		fprintf(stderr, "depth auto %u-%u", sync_data.depth_min, sync_data.depth_max);
+	else
+		fprintf(stderr, "depth %u", sync_data.depth);
+	if (sync_data.latency)
+		fprintf(stderr, ", latency ceiling %u us", (unsigned int) (sync_data.latency / 1000));
+	if (sync_data.frame_interval)
+		fprintf(stderr, ", fps cap %u", (unsigned int) (1000000000ull / sync_data.frame_interval));
+	if (sync_data.swap_interval != SYNC_SWAP_INTERVAL_APP)
+		fprintf(stderr, ", swap interval %d", sync_data.swap_interval);
+	fprintf(stderr, "\n");
+}
+
+/**
+ * \brief resolves real GLX entry points
+ *
+ * Runs exactly once, through sync_init_gl(), when the application first
+ * goes through one of our GLX hooks.
+ */
+static void init_sync_gl(void)
+{
+	sync_gl_initializing = 1;
+
+	/* get glXSwapBuffers() using our pointer to dlsym() */
+	void *libGL_handle = dlopen("libGL.so.1", RTLD_LAZY);
+	if (libGL_handle == NULL) {
+		/* EGL-only applications may run without libGL */
+		fprintf(stderr, "glsync: can't open libGL.so.1, GLX is not paced\n");
+		sync_gl_initializing = 0;
+		return;
+	}
+
+	sync_data.glXGetProcAddressARB = (GLXextFuncPtr (*)(const GLubyte*)) sync_data.dlsym(libGL_handle, "glXGetProcAddressARB");
+	if (sync_data.glXGetProcAddressARB == NULL) {
+		fprintf(stderr, "can't get glXGetProcAddressARB()\n");
+		exit(1);
+	}
+
+	sync_data.glXSwapBuffers = (void (*)(Display*, GLXDrawable)) sync_data.dlsym(libGL_handle, "glXSwapBuffers");
+	if (sync_data.glXSwapBuffers == NULL) {
+		fprintf(stderr, "can't get glXSwapBuffers()\n");
+		exit(1);
+	}
+
+	sync_data.glXGetCurrentContext = (GLXContext (*)(void)) sync_data.dlsym(libGL_handle, "glXGetCurrentContext");
+	if (sync_data.glXGetCurrentContext == NULL) {
+		fprintf(stderr, "can't get glXGetCurrentContext()\n");
+		exit(1);
+	}
+
+	sync_data.glXMakeCurrent = (Bool (*)(Display*, GLXDrawable, GLXContext)) sync_data.dlsym(libGL_handle, "glXMakeCurrent");
+	sync_data.glXMakeContextCurrent = (Bool (*)(Display*, GLXDrawable, GLXDrawable, GLXContext)) sync_data.dlsym(libGL_handle, "glXMakeContextCurrent");
+	sync_data.glXDestroyContext = (void (*)(Display*, GLXContext)) sync_data.dlsym(libGL_handle, "glXDestroyContext");
+	if (!sync_data.glXMakeCurrent || !sync_data.glXMakeContextCurrent || !sync_data.glXDestroyContext) {
+		fprintf(stderr, "can't get GLX context functions\n");
+		exit(1);
+	}
+
+	/* only waiter threads need these, they are not started without them */
+	sync_data.glXQueryContext = (int (*)(Display*, GLXContext, int, int*)) sync_data.dlsym(libGL_handle, "glXQueryContext");
+	sync_data.glXChooseFBConfig = (GLXFBConfig *(*)(Display*, int, const int*, int*)) sync_data.dlsym(libGL_handle, "glXChooseFBConfig");
+	sync_data.glXCreateNewContext = (GLXContext (*)(Display*, GLXFBConfig, int, GLXContext, Bool)) sync_data.dlsym(libGL_handle, "glXCreateNewContext");
+	sync_data.glXCreatePbuffer = (GLXPbuffer (*)(Display*, GLXFBConfig, const int*)) sync_data.dlsym(libGL_handle, "glXCreatePbuffer");
+	sync_data.glXDestroyPbuffer = (void (*)(Display*, GLXPbuffer)) sync_data.dlsym(libGL_handle, "glXDestroyPbuffer");
+	sync_data.glXIsDirect = (Bool (*)(Display*, GLXContext)) sync_data.dlsym(libGL_handle, "glXIsDirect");
+	sync_data.XLockDisplay = (void (*)(Display*)) sync_data.dlsym(RTLD_DEFAULT, "XLockDisplay");
+	sync_data.XUnlockDisplay = (void (*)(Display*)) sync_data.dlsym(RTLD_DEFAULT, "XUnlockDisplay");
+	sync_data.XFree = (int (*)(void*)) sync_data.dlsym(RTLD_DEFAULT, "XFree");
+
+	/*
+	 Extensions, hooks of the swap interval ones are hidden while NULL.
+	 libGL's own export comes first, a libGL that is not linked
+	 symbolically could hand out our entry point from glXGetProcAddress().
+	*/
+#define SYNC_GLX_PROC(name) \
+	sync_data.name = sync_data.dlsym(libGL_handle, #name); \
+	if (sync_data.name == NULL) \
+		sync_data.name = (void *) sync_data.glXGetProcAddressARB((const GLubyte *) #name)
+
+	SYNC_GLX_PROC(glXGetSyncValuesOML);
+	SYNC_GLX_PROC(glXGetMscRateOML);
+	SYNC_GLX_PROC(glXSwapIntervalEXT);
+	SYNC_GLX_PROC(glXSwapIntervalMESA);
+	SYNC_GLX_PROC(glXSwapIntervalSGI);
+
+#undef SYNC_GLX_PROC
+
+	if (!sync_data.glXGetSyncValuesOML || !sync_data.glXGetMscRateOML)
+		sync_data.glXGetSyncValuesOML = NULL;
+
+	sync_resolve_gl((void *(*)(const char *)) sync_data.glXGetProcAddressARB);
+
+	sync_gl_initializing = 0;
+}
+
+/**
+ * \brief creates telemetry shared memory segment, or returns the one created before
+ *
+ * Failure only disables telemetry.
+ * \return segment or NULL
+ */
+static struct glsync_telemetry_s *sync_telemetry_segment(void)
+{
+	struct glsync_telemetry_s *tm;
+	int fd;
+
+	if (sync_data.telemetry_segment)
+		return sync_data.telemetry_segment;
+
+	snprintf(sync_data.telemetry_name, sizeof(sync_data.telemetry_name),
+		 GLSYNC_TELEMETRY_NAME "%d", (int) getpid());
+
+	fd = shm_open(sync_data.telemetry_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror("glsync: can't create telemetry segment");
+		return NULL;
+	}
+
+	if (ftruncate(fd, sizeof(struct glsync_telemetry_s))) {
+		perror("glsync: can't size telemetry segment");
+		close(fd);
+		shm_unlink(sync_data.telemetry_name);
+		return NULL;
+	}
+
+	tm = mmap(NULL, sizeof(struct glsync_telemetry_s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (tm == MAP_FAILED) {
+		perror("glsync: can't map telemetry segment");
+		shm_unlink(sync_data.telemetry_name);
+		return NULL;
+	}
+
+	tm->version = GLSYNC_TELEMETRY_VERSION;
+	tm->frame_size = sizeof(struct glsync_frame_s);
+	tm->nframes = GLSYNC_TELEMETRY_FRAMES;
+	__atomic_store_n(&tm->magic, GLSYNC_TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+
+	sync_data.telemetry_segment = tm;
+	fprintf(stderr, "glsync: telemetry in %s\n", sync_data.telemetry_name);
+	return tm;
+}
+
+/**
+ * \brief turns telemetry on if GLSYNC_TELEMETRY is set
+ */
+static void init_sync_telemetry(void)
+{
+	if (sync_getenv_uint("GLSYNC_TELEMETRY", 0, 1))
+		sync_data.telemetry = sync_telemetry_segment();
+}
+
+/**
+ * \brief publishes one frame record
+ *
+ * Lock-free, safe to call from several render threads at once.
+ */
+static void sync_telemetry_push(struct glsync_telemetry_s *tm, const struct glsync_frame_s *frame)
+{
+	struct glsync_frame_s *rec;
+	uint64_t n;
+
+	n = __atomic_fetch_add(&tm->head, 1, __ATOMIC_RELAXED);
+	rec = &tm->frame[n & (GLSYNC_TELEMETRY_FRAMES - 1)];
+
+	__atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	rec->time = frame->time;
+	rec->chain = frame->chain;
+	rec->frame_ns = frame->frame_ns;
+	rec->cpu_ns = frame->cpu_ns;
+	rec->swap_ns = frame->swap_ns;
+	rec->wait_ns = frame->wait_ns;
+	rec->wait_cpu_ns = frame->wait_cpu_ns;
+	rec->limit_ns = frame->limit_ns;
+	rec->gpu_ns = frame->gpu_ns;
+	rec->gpu_age = frame->gpu_age;
+	rec->margin_ns = frame->margin_ns;
+	rec->error_ns = frame->error_ns;
+	rec->depth = frame->depth;
+	rec->decision = frame->decision;
+	rec->latency_ns = frame->latency_ns;
+	__atomic_store_n(&rec->seq, n + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * \brief publishes settings in effect to the control block
+ *
+ * Called with sync_control.mutex held, or before anything can swap.
+ */
+static void sync_control_publish(struct glsync_control_s *ctl)
+{
+	struct glsync_settings_s *cur = &ctl->current;
+	uint32_t seq = ctl->current_seq;
+
+	__atomic_store_n(&ctl->current_seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	cur->depth = sync_data.depth_auto ? GLSYNC_CONTROL_DEPTH_AUTO : sync_data.depth;
+	cur->fps = sync_data.frame_interval ? 1000000000ull / sync_data.frame_interval : 0;
+	cur->telemetry = sync_data.telemetry != NULL;
+	memset(cur->wait, 0, sizeof(cur->wait));
+	strncpy(cur->wait, sync_wait_names[sync_data.wait], sizeof(cur->wait) - 1);
+
+	__atomic_store_n(&ctl->current_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * \brief checks a control request and applies it if it is valid
+ *
+ * Nothing is changed unless everything can be.
+ * \return 0 on success, errno value otherwise
+ */
+static int sync_control_apply(const struct glsync_settings_s *req)
+{
+	struct glsync_telemetry_s *tm = NULL;
+	unsigned int wait;
+
+	if (req->depth > SYNC_MAX_DEPTH && req->depth != GLSYNC_CONTROL_DEPTH_AUTO)
+		return EINVAL;
+	if (req->fps > SYNC_MAX_FPS || req->telemetry > 1)
+		return EINVAL;
+
+	for (wait = 0; sync_wait_names[wait]; wait++) {
+		if (!strncmp(req->wait, sync_wait_names[wait], sizeof(req->wait)))
+			break;
+	}
+	if (sync_wait_names[wait] == NULL)
+		return EINVAL;
+
+	/* rings hand their fences to a waiter thread, or not, when they are created */
+	if ((wait == SYNC_WAIT_ASYNC) != (sync_data.wait == SYNC_WAIT_ASYNC))
+		return ENOTSUP;
+
+	if (req->telemetry && (tm = sync_telemetry_segment()) == NULL)
+		return EIO;
+
+	if (req->depth == GLSYNC_CONTROL_DEPTH_AUTO) {
+		if (!sync_data.depth_auto)
+			sync_depth_auto();
+	} else {
+		__atomic_store_n(&sync_data.depth_auto, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&sync_data.depth, req->depth, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&sync_data.frame_interval, req->fps ? 1000000000ull / req->fps : 0,
+			 __ATOMIC_RELAXED);
+	__atomic_store_n(&sync_data.wait, wait, __ATOMIC_RELAXED);
+	__atomic_store_n(&sync_data.telemetry, tm, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/**
+ * \brief applies a pending control request
+ *
+ * Costs one load when nothing is pending. Runs at the start of a swap,
+ * before the swap reads any setting, and a request is applied by one swap
+ * only. Other threads pick the new settings up at their next swap.
+ */
+static void sync_control_poll(void)
+{
+	struct glsync_control_s *ctl = sync_control.block;
+	struct glsync_settings_s req;
+	uint32_t seq;
+	int status;
+
+	seq = __atomic_load_n(&ctl->request_seq, __ATOMIC_ACQUIRE);
+	if (seq == __atomic_load_n(&sync_control.seq, __ATOMIC_RELAXED) || (seq & 1))
+		return;
+
+	/* someone else is applying it */
+	if (pthread_mutex_trylock(&sync_control.mutex))
+		return;
+
+	seq = __atomic_load_n(&ctl->request_seq, __ATOMIC_ACQUIRE);
+	if (seq == sync_control.seq || (seq & 1))
+		goto out;
+
+	memcpy(&req, &ctl->request, sizeof(req));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&ctl->request_seq, __ATOMIC_RELAXED) != seq)
+		goto out;
+
+	status = sync_control_apply(&req);
+	if (status == 0) {
+		__atomic_add_fetch(&sync_control.generation, 1, __ATOMIC_RELEASE);
+		sync_control_publish(ctl);
+
+		fprintf(stderr, "glsync: control: %s wait, ", sync_wait_names[sync_data.wait]);
+		if (sync_data.depth_auto)
+			fprintf(stderr, "depth auto %u-%u", sync_data.depth_min, sync_data.depth_max);
+		else
+			fprintf(stderr, "depth %u", sync_data.depth);
+		if (req.fps)
+			fprintf(stderr, ", fps cap %u", req.fps);
+		fprintf(stderr, ", telemetry %s\n", sync_data.telemetry ? "on" : "off");
+	} else
+		fprintf(stderr, "glsync: control request rejected: %s\n", strerror(status));
+
+	ctl->status = status;
+	__atomic_store_n(&ctl->done, seq, __ATOMIC_RELEASE);
+	__atomic_store_n(&sync_control.seq, seq, __ATOMIC_RELAXED);
+out:
+	pthread_mutex_unlock(&sync_control.mutex);
+}
+
+/**
+ * \brief creates control block if GLSYNC_CONTROL is set
+ *
+ * Failure only disables runtime control.
+ */
+static void init_sync_control(void)
+{
+	struct glsync_control_s *ctl;
+	int fd;
+
+	if (!sync_getenv_uint("GLSYNC_CONTROL", 0, 1))
+		return;
+
+	snprintf(sync_control.name, sizeof(sync_control.name),
+		 GLSYNC_CONTROL_NAME "%d", (int) getpid());
+
+	/* whoever can write this retunes the process, so only its owner */
+	fd = shm_open(sync_control.name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		perror("glsync: can't create control block");
+		return;
+	}
+
+	if (ftruncate(fd, sizeof(struct glsync_control_s))) {
+		perror("glsync: can't size control block");
+		close(fd);
+		shm_unlink(sync_control.name);
+		return;
+	}
+
+	ctl = mmap(NULL, sizeof(struct glsync_control_s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ctl == MAP_FAILED) {
+		perror("glsync: can't map control block");
+		shm_unlink(sync_control.name);
+		return;
+	}
+
+	ctl->version = GLSYNC_CONTROL_VERSION;
+	ctl->pid = getpid();
+	sync_control_publish(ctl);
+	__atomic_store_n(&ctl->magic, GLSYNC_CONTROL_MAGIC, __ATOMIC_RELEASE);
+
+	sync_control.block = ctl;
+	fprintf(stderr, "glsync: control block in %s\n", sync_control.name);
+}
+
+/**
+ * \brief KHR_debug callback
+ *
+ * May be called from driver threads, so it only formats the message into
+ * sync_debug and leaves printing to sync_debug_thread(). Messages are
+ * dropped while the buffer is full.
+ */
+static void GLAPIENTRY sync_debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+					   GLsizei length, const GLchar *message, const void *user)
+{
+	struct sync_debug_msg_s *msg;
+	uint64_t n;
+
+	n = __atomic_load_n(&sync_debug.head, __ATOMIC_RELAXED);
+	do {
+		if (n - __atomic_load_n(&sync_debug.tail, __ATOMIC_ACQUIRE) >= SYNC_DEBUG_MESSAGES) {
+			__atomic_fetch_add(&sync_debug.dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&sync_debug.head, &n, n + 1, 1,
+					      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	msg = &sync_debug.msg[n % SYNC_DEBUG_MESSAGES];
+	snprintf(msg->text, sizeof(msg->text), "GL debug: source 0x%x type 0x%x id %u severity 0x%x: %.*s",
+		 source, type, id, severity, length < 0 ? (int) strlen(message) : (int) length, message);
+	__atomic_store_n(&msg->seq, n + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * \brief prints messages queued by sync_debug_callback()
+ */
+static void sync_debug_flush(void)
+{
+	struct sync_debug_msg_s *msg;
+	uint64_t tail, dropped;
+
+	tail = __atomic_load_n(&sync_debug.tail, __ATOMIC_RELAXED);
+	for (;;) {
+		msg = &sync_debug.msg[tail % SYNC_DEBUG_MESSAGES];
+		if (__atomic_load_n(&msg->seq, __ATOMIC_ACQUIRE) != tail + 1)
+			break;
+
+		fprintf(stderr, "%s\n", msg->text);
+		tail++;
+		__atomic_store_n(&sync_debug.tail, tail, __ATOMIC_RELEASE);
+	}
+
+	dropped = __atomic_exchange_n(&sync_debug.dropped, 0, __ATOMIC_RELAXED);
+	if (dropped)
+		fprintf(stderr, "GL debug: %llu messages dropped\n", (unsigned long long) dropped);
+}
+
+/**
+ * \brief logger thread of GLSYNC_DEBUG mode
+ */
+static void *sync_debug_thread(void *arg)
+{
+	for (;;) {
+		sync_sleep_until(sync_now() + SYNC_DEBUG_INTERVAL_NS);
+		sync_debug_flush();
+	}
+
+	return NULL;
+}
+
+/**
+ * \brief installs debug callback into the current context
+ *
+ * An application that set up its own callback keeps it.
+ */
+static void sync_debug_attach(void)
+{
+	void *prev = NULL;
+
+	sync_data.glGetPointerv(GL_DEBUG_CALLBACK_FUNCTION, &prev);
+	if (prev != NULL)
+		return;
+
+	sync_data.glDebugMessageCallback(sync_debug_callback, NULL);
+	sync_data.glEnable(GL_DEBUG_OUTPUT);
+}
+
+/**
+ * \brief sets up what only processes that swap need
+ *
+ * Runs exactly once, from the first swap, so helpers the application
+ * is launched through get no shared memory segments.
+ */
+static void init_sync_swap(void)
+{
+	pthread_t thread;
+
+	init_sync_telemetry();
+	init_sync_control();
+
+	if (sync_data.debug) {
+		if (pthread_create(&thread, NULL, sync_debug_thread, NULL)) {
+			fprintf(stderr, "glsync: can't start logger thread, GLSYNC_DEBUG ignored\n");
+			sync_data.debug = 0;
+		} else
+			pthread_detach(thread);
+	}
+}
+
+/**
+ * \brief makes sure sync_data is initialized
+ */
+static void sync_init(void)
+{
+	pthread_once(&sync_once, init_sync_data);
+}
+
+/**
+ * \brief makes sure real GLX entry points are resolved
+ *
+ * dlopen() in init_sync_gl() may run constructors that look up GLX
+ * functions through us on the same thread, those must not wait for
+ * the once guard they are already inside of.
+ */
+static void sync_init_gl(void)
+{
+	sync_init();
+
+	if (!sync_gl_initializing)
+		pthread_once(&sync_gl_once, init_sync_gl);
+}
+
+/**
+ * \brief resolves real EGL entry points
+ *
+ * Runs exactly once, through sync_init_egl(), when the application first
+ * goes through one of our EGL hooks, so it has libEGL loaded by then.
+ */
+static void init_sync_egl(void)
+{
+	void *libEGL_handle;
+
+	libEGL_handle = dlopen("libEGL.so.1", RTLD_LAZY | RTLD_NOLOAD);
+	if (libEGL_handle == NULL)
+		libEGL_handle = dlopen("libEGL.so.1", RTLD_LAZY);
+	if (libEGL_handle == NULL) {
+		fprintf(stderr, "can't open libEGL.so.1\n");
+		exit(1);
+	}
+
+	sync_data.eglGetProcAddress = (EGLextFuncPtr (*)(const char*)) sync_data.dlsym(libEGL_handle, "eglGetProcAddress");
+	if (sync_data.eglGetProcAddress == NULL) {
+		fprintf(stderr, "can't get eglGetProcAddress()\n");
+		exit(1);
+	}
+
+	sync_data.eglSwapBuffers = (EGLBoolean (*)(EGLDisplay, EGLSurface)) sync_data.dlsym(libEGL_handle, "eglSwapBuffers");
+	if (sync_data.eglSwapBuffers == NULL) {
+		fprintf(stderr, "can't get eglSwapBuffers()\n");
+		exit(1);
+	}
+
+	sync_data.eglGetCurrentContext = (EGLContext (*)(void)) sync_data.dlsym(libEGL_handle, "eglGetCurrentContext");
+	sync_data.eglQueryAPI = (EGLenum (*)(void)) sync_data.dlsym(libEGL_handle, "eglQueryAPI");
+	sync_data.eglQueryString = (const char *(*)(EGLDisplay, EGLint)) sync_data.dlsym(libEGL_handle, "eglQueryString");
+	sync_data.eglMakeCurrent = (EGLBoolean (*)(EGLDisplay, EGLSurface, EGLSurface, EGLContext)) sync_data.dlsym(libEGL_handle, "eglMakeCurrent");
+	sync_data.eglDestroyContext = (EGLBoolean (*)(EGLDisplay, EGLContext)) sync_data.dlsym(libEGL_handle, "eglDestroyContext");
+	if (!sync_data.eglGetCurrentContext || !sync_data.eglQueryAPI || !sync_data.eglQueryString ||
+	    !sync_data.eglMakeCurrent || !sync_data.eglDestroyContext) {
+		fprintf(stderr, "can't get EGL context functions\n");
+		exit(1);
+	}
+
+	/* only waiter threads need these */
+	sync_data.eglQueryContext = (EGLBoolean (*)(EGLDisplay, EGLContext, EGLint, EGLint*)) sync_data.dlsym(libEGL_handle, "eglQueryContext");
+	sync_data.eglChooseConfig = (EGLBoolean (*)(EGLDisplay, const EGLint*, EGLConfig*, EGLint, EGLint*)) sync_data.dlsym(libEGL_handle, "eglChooseConfig");
+	sync_data.eglCreateContext = (EGLContext (*)(EGLDisplay, EGLConfig, EGLContext, const EGLint*)) sync_data.dlsym(libEGL_handle, "eglCreateContext");
+	sync_data.eglBindAPI = (EGLBoolean (*)(EGLenum)) sync_data.dlsym(libEGL_handle, "eglBindAPI");
+	sync_data.eglReleaseThread = (EGLBoolean (*)(void)) sync_data.dlsym(libEGL_handle, "eglReleaseThread");
+
+	/* extensions, NULL when not supported */
+#define SYNC_EGL_PROC(name) \
+	sync_data.name = (void *) sync_data.eglGetProcAddress(#name)
+
+	SYNC_EGL_PROC(eglSwapBuffersWithDamageKHR);
+	SYNC_EGL_PROC(eglSwapBuffersWithDamageEXT);
+	SYNC_EGL_PROC(eglCreateSyncKHR);
+	SYNC_EGL_PROC(eglClientWaitSyncKHR);
+	SYNC_EGL_PROC(eglDestroySyncKHR);
+
+#undef SYNC_EGL_PROC
+
+	if (!sync_data.eglCreateSyncKHR || !sync_data.eglClientWaitSyncKHR || !sync_data.eglDestroySyncKHR)
+		sync_data.eglCreateSyncKHR = NULL;
+
+	sync_resolve_gl((void *(*)(const char *)) sync_data.eglGetProcAddress);
+}
+
+/**
+ * \brief makes sure real EGL entry points are resolved
+ */
+static void sync_init_egl(void)
+{
+	sync_init();
+	pthread_once(&sync_egl_once, init_sync_egl);
+}
+
+#ifdef GLSYNC_GOT
+static unsigned int sync_got_patch(void);
+#endif
+
+/**
+ * \brief library constructor
+ *
+ * Every process we are preloaded into runs this, GL or not, so GL is
+ * left for the first hook to resolve.
+ */
+__attribute__ ((constructor)) static void sync_constructor(void)
+{
+	sync_init();
+	if (sync_data.off)
+		return;
+
+#ifdef GLSYNC_GOT
+	fprintf(stderr, "glsync: GOT mode, %u slots patched\n", sync_got_patch());
+#endif
+}
+
+/**
+ * \brief library destructor
+ */
+__attribute__ ((destructor)) static void sync_destructor(void)
+{
+	if (sync_data.debug)
+		sync_debug_flush();
+
+	if (sync_data.telemetry_segment)
+		shm_unlink(sync_data.telemetry_name);
+	if (sync_control.block)
+		shm_unlink(sync_control.name);
+}
+
+/**
+ * \brief inserts fence into current context's command stream
+ * \return fence or NULL
+ */
+static void *sync_fence_create(struct sync_ring_s *ring)
+{
+	switch (ring->kind) {
+	case SYNC_FENCE_GL:
+		return sync_data.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	case SYNC_FENCE_EGL:
+		return sync_data.eglCreateSyncKHR(ring->dpy, EGL_SYNC_FENCE_KHR, NULL);
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * \brief waits for fence up to timeout ns
+ * \param flush flush the context first so the fence is sure to signal
+ * \param timeout 0 to just check, UINT64_MAX to wait as long as it takes
+ */
+static enum sync_fence_status_e sync_fence_check(struct sync_ring_s *ring, void *fence,
+						 int flush, uint64_t timeout)
+{
+	GLenum ret;
+	EGLint eret;
+
+	/* GL_TIMEOUT_IGNORED and EGL_FOREVER_KHR are both UINT64_MAX */
+	if (ring->kind == SYNC_FENCE_GL) {
+		ret = sync_data.glClientWaitSync(fence, flush ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, timeout);
+		if (ret == GL_TIMEOUT_EXPIRED)
+			return SYNC_FENCE_TIMEOUT;
+		return ret == GL_WAIT_FAILED ? SYNC_FENCE_FAILED : SYNC_FENCE_SIGNALED;
+	}
+
+	eret = sync_data.eglClientWaitSyncKHR(ring->dpy, fence, flush ? EGL_SYNC_FLUSH_COMMANDS_BIT_KHR : 0, timeout);
+	if (eret == EGL_TIMEOUT_EXPIRED_KHR)
+		return SYNC_FENCE_TIMEOUT;
+	return eret == EGL_FALSE ? SYNC_FENCE_FAILED : SYNC_FENCE_SIGNALED;
+}
+
+/**
+ * \brief deletes fence
+ */
+static void sync_fence_delete(struct sync_ring_s *ring, void *fence)
+{
+	if (ring->kind == SYNC_FENCE_GL)
+		sync_data.glDeleteSync(fence);
+	else
+		sync_data.eglDestroySyncKHR(ring->dpy, fence);
+}
+
+/**
+ * \brief polls fence, sleeping with exponential backoff between polls
+ * \param sleep first sleep in ns
+ */
+static enum sync_fence_status_e sync_fence_poll(struct sync_ring_s *ring, void *fence, uint64_t sleep)
+{
+	enum sync_fence_status_e ret;
+
+	for (;;) {
+		ret = sync_fence_check(ring, fence, 0, 0);
+		if (ret != SYNC_FENCE_TIMEOUT)
+			return ret;
+
+		sync_sleep_until(sync_now() + sleep);
+		if (sleep < SYNC_POLL_MAX_NS)
+			sleep *= 2;
+	}
+}
+
+/**
+ * \brief waits for fence using policy set by GLSYNC_WAIT
+ * \param ring ring the fence belongs to, its latency estimate is used and updated
+ * \param sync fence
+ * \param created time the fence was created
+ */
+static void sync_fence_wait(struct sync_ring_s *ring, void *sync, uint64_t created)
+{
+	enum sync_wait_e wait = __atomic_load_n(&sync_data.wait, __ATOMIC_RELAXED);
+	enum sync_fence_status_e ret;
+	uint64_t expected, now;
+
+	/* first check also flushes, so the fence is sure to signal */
+	ret = sync_fence_check(ring, sync, 1, wait == SYNC_WAIT_BLOCK ||
+			       wait == SYNC_WAIT_ASYNC ? UINT64_MAX : 0);
+
+	if (ret == SYNC_FENCE_TIMEOUT && wait == SYNC_WAIT_POLL) {
+		ret = sync_fence_poll(ring, sync, SYNC_POLL_MIN_NS);
+	} else if (ret == SYNC_FENCE_TIMEOUT) {
+		/* hybrid: sleep through most of the expected latency, spin the rest */
+		expected = created + ring->latency;
+		now = sync_now();
+		if (ring->latency && now + sync_data.spin < expected)
+			sync_sleep_until(expected - sync_data.spin);
+
+		while ((ret = sync_fence_check(ring, sync, 0, 0)) == SYNC_FENCE_TIMEOUT) {
+			if (sync_now() > expected + sync_data.spin) {
+				ret = sync_fence_poll(ring, sync, SYNC_POLL_MIN_NS);
+				break;
+			}
+			sync_cpu_relax();
+		}
+	}
+
+	/* glGetError() would steal the error from the application */
+	if (ret == SYNC_FENCE_FAILED && !ring->failed) {
+		fprintf(stderr, "glsync: waiting for fence failed\n");
+		ring->failed = 1;
+	}
+
+	now = sync_now();
+	if (ring->latency)
+		ring->latency = (ring->latency * 7 + (now - created)) / 8;
+	else
+		ring->latency = now - created;
+}
+
+static long sync_futex(uint32_t *addr, int op, uint32_t val)
+{
+	return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+/**
+ * \brief makes or releases waiter's hidden context in calling thread
+ * \param bind 1 to make hidden context current, 0 to release it
+ * \return 0 on success
+ */
+static int sync_waiter_current(struct sync_waiter_s *w, int bind)
+{
+	Bool ret;
+
+	if (w->api == SYNC_API_EGL) {
+		if (bind && !sync_data.eglBindAPI(w->egl_api))
+			return 1;
+		return !sync_data.eglMakeCurrent(w->dpy, EGL_NO_SURFACE, EGL_NO_SURFACE,
+						 bind ? w->hidden : EGL_NO_CONTEXT);
+	}
+
+	/* application's connection, Xlib serializes us if it is thread safe */
+	if (sync_data.XLockDisplay)
+		sync_data.XLockDisplay(w->dpy);
+	ret = sync_data.glXMakeContextCurrent(w->dpy, bind ? w->pbuffer : None,
+					      bind ? w->pbuffer : None, bind ? w->hidden : NULL);
+	if (sync_data.XUnlockDisplay)
+		sync_data.XUnlockDisplay(w->dpy);
+
+	return !ret;
+}
+
+/**
+ * \brief waits for queued fences in order and publishes completion
+ */
+static void *sync_waiter_thread(void *arg)
+{
+	struct sync_waiter_s *w = arg;
+	void *fence;
+	uint64_t created;
+	int failed = 0;
+
+	if (w->hidden)
+		failed = sync_waiter_current(w, 1);
+
+	pthread_mutex_lock(&w->mutex);
+	w->failed = failed;
+	w->started = 1;
+	pthread_cond_broadcast(&w->space_cond);
+
+	while (!failed) {
+		while (w->ring.count == 0 && !w->quit)
+			pthread_cond_wait(&w->queue_cond, &w->mutex);
+		if (w->ring.count == 0)
+			break;
+
+		fence = w->ring.fence[w->ring.head];
+		created = w->ring.created[w->ring.head];
+		pthread_mutex_unlock(&w->mutex);
+
+		sync_fence_wait(&w->ring, fence, created);
+		sync_fence_delete(&w->ring, fence);
+		__atomic_fetch_add(&sync_data.frames_completed, 1, __ATOMIC_RELAXED);
+
+		pthread_mutex_lock(&w->mutex);
+		w->ring.head = (w->ring.head + 1) % (SYNC_MAX_DEPTH + 1);
+		w->ring.count--;
+		pthread_cond_broadcast(&w->space_cond);
+
+		__atomic_store_n(&w->completed, w->completed + 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&w->sleepers, __ATOMIC_SEQ_CST))
+			sync_futex(&w->completed, FUTEX_WAKE_PRIVATE, INT_MAX);
+	}
+	pthread_mutex_unlock(&w->mutex);
+
+	if (w->hidden && !failed) {
+		sync_waiter_current(w, 0);
+		if (w->api == SYNC_API_EGL)
+			sync_data.eglReleaseThread();
+	}
+
+	return NULL;
+}
+
+/**
+ * \brief hands fence over to waiter thread
+ *
+ * Blocks while the waiter already holds SYNC_MAX_DEPTH + 1 fences, which
+ * only happens when several chains share a context.
+ * \return sequence number completed reaches once the fence is retired
+ */
+static uint32_t sync_waiter_push(struct sync_waiter_s *w, void *sync, uint64_t created)
+{
+	unsigned int i;
+	uint32_t seq;
+
+	pthread_mutex_lock(&w->mutex);
+	while (w->ring.count == SYNC_MAX_DEPTH + 1)
+		pthread_cond_wait(&w->space_cond, &w->mutex);
+
+	i = (w->ring.head + w->ring.count) % (SYNC_MAX_DEPTH + 1);
+	w->ring.fence[i] = sync;
+	w->ring.created[i] = created;
+	w->ring.count++;
+	seq = ++w->queued;
+	pthread_cond_signal(&w->queue_cond);
+	pthread_mutex_unlock(&w->mutex);
+
+	return seq;
+}
+
+/**
+ * \brief sleeps until waiter has retired fence with given sequence number
+ */
+static void sync_waiter_wait(struct sync_waiter_s *w, uint32_t seq)
+{
+	uint32_t done;
+
+	for (;;) {
+		done = __atomic_load_n(&w->completed, __ATOMIC_SEQ_CST);
+		if ((int32_t) (done - seq) >= 0)
+			return;
+
+		/* futex rechecks completed, a wake between load and sleep is not lost */
+		__atomic_fetch_add(&w->sleepers, 1, __ATOMIC_SEQ_CST);
+		sync_futex(&w->completed, FUTEX_WAIT_PRIVATE, done);
+		__atomic_fetch_sub(&w->sleepers, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+/**
+ * \brief creates GLX context sharing objects with ctx, and a pbuffer for it
+ * \return 0 on success
+ */
+static int sync_waiter_create_glx(struct sync_waiter_s *w, Display *dpy, GLXContext ctx)
+{
+	int config_attr[] = { GLX_FBCONFIG_ID, 0, None };
+	int pbuffer_attr[] = { GLX_PBUFFER_WIDTH, 1, GLX_PBUFFER_HEIGHT, 1, None };
+	GLXFBConfig *configs;
+	int screen = 0, n = 0;
+
+	if (!sync_data.glXQueryContext || !sync_data.glXChooseFBConfig || !sync_data.glXCreateNewContext ||
+	    !sync_data.glXCreatePbuffer || !sync_data.glXDestroyPbuffer || !sync_data.glXIsDirect)
+		return 1;
+
+	if (sync_data.glXQueryContext(dpy, ctx, GLX_FBCONFIG_ID, &config_attr[1]) != Success ||
+	    sync_data.glXQueryContext(dpy, ctx, GLX_SCREEN, &screen) != Success)
+		return 1;
+
+	configs = sync_data.glXChooseFBConfig(dpy, screen, config_attr, &n);
+	if (configs == NULL)
+		return 1;
+
+	if (n > 0) {
+		w->hidden = sync_data.glXCreateNewContext(dpy, configs[0], GLX_RGBA_TYPE, ctx,
+							  sync_data.glXIsDirect(dpy, ctx));
+		if (w->hidden)
+			w->pbuffer = sync_data.glXCreatePbuffer(dpy, configs[0], pbuffer_attr);
+	}
+	if (sync_data.XFree)
+		sync_data.XFree(configs);
+
+	if (w->hidden && !w->pbuffer) {
+		sync_data.glXDestroyContext(dpy, w->hidden);
+		w->hidden = NULL;
+	}
+
+	return w->hidden == NULL;
+}
+
+/**
+ * \brief creates surfaceless EGL context sharing objects with ctx
+ * \return 0 on success
+ */
+static int sync_waiter_create_egl(struct sync_waiter_s *w, EGLDisplay dpy, EGLContext ctx)
+{
+	EGLint config_attr[] = { EGL_CONFIG_ID, 0, EGL_NONE };
+	EGLint context_attr[] = { EGL_NONE, 0, EGL_NONE };
+	const char *ext;
+	EGLConfig config;
+	EGLint n = 0;
+
+	if (!sync_data.eglQueryContext || !sync_data.eglChooseConfig || !sync_data.eglCreateContext ||
+	    !sync_data.eglBindAPI || !sync_data.eglReleaseThread)
+		return 1;
+
+	ext = sync_data.eglQueryString(dpy, EGL_EXTENSIONS);
+	if (!ext || !strstr(ext, "EGL_KHR_surfaceless_context"))
+		return 1;
+
+	if (!sync_data.eglQueryContext(dpy, ctx, EGL_CONFIG_ID, &config_attr[1]) ||
+	    !sync_data.eglChooseConfig(dpy, config_attr, &config, 1, &n) || n == 0)
+		return 1;
+
+	if (w->egl_api == EGL_OPENGL_ES_API) {
+		context_attr[0] = EGL_CONTEXT_CLIENT_VERSION;
+		if (!sync_data.eglQueryContext(dpy, ctx, EGL_CONTEXT_CLIENT_VERSION, &context_attr[1]))
+			return 1;
+	}
+
+	w->hidden = sync_data.eglCreateContext(dpy, config, ctx, context_attr);
+	if (w->hidden == EGL_NO_CONTEXT)
+		w->hidden = NULL;
+
+	return w->hidden == NULL;
+}
+
+/**
+ * \brief destroys hidden context, thread must have exited
+ */
+static void sync_waiter_destroy_hidden(struct sync_waiter_s *w)
+{
+	if (w->hidden == NULL)
+		return;
+
+	if (w->api == SYNC_API_EGL) {
+		sync_data.eglDestroyContext(w->dpy, w->hidden);
+	} else {
+		sync_data.glXDestroyPbuffer(w->dpy, w->pbuffer);
+		sync_data.glXDestroyContext(w->dpy, w->hidden);
+	}
+
+	w->hidden = NULL;
+	w->pbuffer = 0;
+}
+
+/**
+ * \brief finds or starts waiter thread of ctx
+ *
+ * Called from a swap with ctx current, so the hidden context is created
+ * on the application's thread and only made current on the waiter's.
+ * \param kind fence kind of the chain asking
+ * \return waiter or NULL if fences must be waited for in swap
+ */
+static struct sync_waiter_s *sync_waiter_get(enum sync_api_e api, void *dpy, void *ctx,
+					     enum sync_fence_e kind)
+{
+	struct sync_waiter_s *w = NULL;
+	unsigned int i;
+
+	if (__atomic_load_n(&sync_data.wait, __ATOMIC_RELAXED) != SYNC_WAIT_ASYNC ||
+	    kind == SYNC_FENCE_NONE)
+		return NULL;
+
+	pthread_mutex_lock(&sync_waiters.mutex);
+	for (i = 0; i < SYNC_MAX_WAITERS; i++) {
+		if (sync_waiters.waiter[i].ctx == ctx) {
+			w = &sync_waiters.waiter[i];
+			pthread_mutex_unlock(&sync_waiters.mutex);
+			return w->failed || w->ring.kind != kind ? NULL : w;
+		}
+
+		if (w == NULL && sync_waiters.waiter[i].ctx == NULL)
+			w = &sync_waiters.waiter[i];
+	}
+
+	if (w == NULL) {
+		pthread_mutex_unlock(&sync_waiters.mutex);
+		return NULL;
+	}
+
+	memset(w, 0, sizeof(struct sync_waiter_s));
+	pthread_mutex_init(&w->mutex, NULL);
+	pthread_cond_init(&w->queue_cond, NULL);
+	pthread_cond_init(&w->space_cond, NULL);
+	w->ctx = ctx;
+	w->api = api;
+	w->dpy = dpy;
+	w->ring.kind = kind;
+	w->ring.dpy = dpy;
+	w->failed = 1;
+
+	/* EGL fences can be waited for without a context */
+	if (kind == SYNC_FENCE_GL) {
+		if (api == SYNC_API_EGL) {
+			w->egl_api = sync_data.eglQueryAPI();
+			if (sync_waiter_create_egl(w, dpy, ctx))
+				goto fail;
+		} else if (sync_waiter_create_glx(w, dpy, ctx))
+			goto fail;
+	}
+
+	if (pthread_create(&w->thread, NULL, sync_waiter_thread, w))
+		goto fail;
+
+	pthread_mutex_lock(&w->mutex);
+	while (!w->started)
+		pthread_cond_wait(&w->space_cond, &w->mutex);
+	pthread_mutex_unlock(&w->mutex);
+
+	if (w->failed) {
+		pthread_join(w->thread, NULL);
+		goto fail;
+	}
+
+	pthread_mutex_unlock(&sync_waiters.mutex);
+	return w;
+
+fail:
+	/* slot stays taken so ctx is not retried on every new chain */
+	fprintf(stderr, "glsync: can't start fence waiter, waiting in swap\n");
+	sync_waiter_destroy_hidden(w);
+	w->failed = 1;
+	w->started = 0;
+	pthread_mutex_unlock(&sync_waiters.mutex);
+	return NULL;
+}
+
+/**
+ * \brief stops waiter thread of ctx after it has retired all its fences
+ *
+ * Called before ctx is destroyed, so the hidden context keeps the fences
+ * alive until then.
+ */
+static void sync_waiter_stop(void *ctx)
+{
+	struct sync_waiter_s *w;
+	unsigned int i;
+
+	pthread_mutex_lock(&sync_waiters.mutex);
+	for (i = 0; i < SYNC_MAX_WAITERS; i++) {
+		w = &sync_waiters.waiter[i];
+		if (w->ctx != ctx)
+			continue;
+
+		if (!w->failed) {
+			pthread_mutex_lock(&w->mutex);
+			w->quit = 1;
+			pthread_cond_signal(&w->queue_cond);
+			pthread_mutex_unlock(&w->mutex);
+			pthread_join(w->thread, NULL);
+			sync_waiter_destroy_hidden(w);
+		}
+
+		pthread_mutex_destroy(&w->mutex);
+		pthread_cond_destroy(&w->queue_cond);
+		pthread_cond_destroy(&w->space_cond);
+		w->ctx = NULL;
+	}
+	pthread_mutex_unlock(&sync_waiters.mutex);
+}
+
+/**
+ * \brief appends fence of just submitted frame to ring
+ *
+ * With a waiter the fence is handed over to it and only its sequence
+ * number is kept.
+ */
+static void sync_ring_push(struct sync_ring_s *ring, void *sync, uint64_t created)
+{
+	unsigned int i = (ring->head + ring->count) % (SYNC_MAX_DEPTH + 1);
+
+	ring->fence[i] = sync;
+	ring->created[i] = created;
+	if (ring->waiter)
+		ring->seq[i] = sync_waiter_push(ring->waiter, sync, created);
+	ring->count++;
+	__atomic_fetch_add(&sync_data.frames_submitted, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief waits for and deletes oldest fences until at most keep are left
+ *
+ * Must be called with the context that created the fences current. With a
+ * waiter this only sleeps until the waiter has retired them.
+ * \return creation time of the newest fence retired, 0 if none was
+ */
+static uint64_t sync_ring_retire(struct sync_ring_s *ring, unsigned int keep)
+{
+	uint64_t created = 0;
+
+	while (ring->count > keep) {
+		void *oldest = ring->fence[ring->head];
+
+		if (ring->waiter) {
+			sync_waiter_wait(ring->waiter, ring->seq[ring->head]);
+		} else {
+			sync_fence_wait(ring, oldest, ring->created[ring->head]);
+			sync_fence_delete(ring, oldest);
+			__atomic_fetch_add(&sync_data.frames_completed, 1, __ATOMIC_RELAXED);
+		}
+
+		created = ring->created[ring->head];
+		ring->head = (ring->head + 1) % (SYNC_MAX_DEPTH + 1);
+		ring->count--;
+	}
+
+	return created;
+}
+
+/**
+ * \brief frame rate limiter
+ *
+ * Deadlines advance by a fixed interval from the previous deadline, not
+ * from the time the frame finished, so errors do not accumulate. A chain
+ * that falls more than a frame behind starts over from now instead of
+ * bursting to catch up.
+ */
+static void sync_limit(struct sync_chain_s *chain, uint64_t now, uint64_t interval)
+{
+	if (chain->deadline == 0 || now > chain->deadline + interval) {
+		chain->deadline = now + interval;
+		return;
+	}
+
+	if (now < chain->deadline)
+		sync_wait_until(chain->deadline);
+
+	chain->deadline += interval;
+}
+
+/**
+ * \brief advances jit deadline by GLSYNC_FPS frame interval
+ *
+ * Deadline is when the next frame should be finished, not when it starts.
+ */
+static void sync_jit_deadline(struct sync_chain_s *chain, uint64_t now, uint64_t interval)
+{
+	if (chain->deadline == 0 || now > chain->deadline + interval)
+		chain->deadline = now + interval;
+	else
+		chain->deadline += interval;
+}
+
+/**
+ * \brief jit mode pacing
+ *
+ * A frame costs the application CPU time since the previous swap plus
+ * the fence wait after it. Instead of returning right away, hold the
+ * application back until the next deadline minus the predicted cost and
+ * a safety margin, so it samples input as late as possible. The margin
+ * covers 99% of the last SYNC_JIT_ERRORS frames that completed later than
+ * predicted, since a single late frame is what shows, but never drops
+ * below GLSYNC_JIT_MARGIN_US. Completion rather than cost is compared, so
+ * oversleeping the start counts too.
+ * \param chain swap chain, deadline already advanced to the next frame's
+ * \param now time the fence wait finished
+ * \param cost cost of the frame that just finished
+ * \param frame telemetry record to fill
+ */
+static void sync_jit(struct sync_chain_s *chain, uint64_t now, uint64_t cost,
+		     struct glsync_frame_s *frame)
+{
+	uint64_t margin, start;
+	uint32_t top[SYNC_JIT_ERRORS / 100 + 1] = { 0 }, over;
+	int64_t error = 0;
+	unsigned int i, j;
+
+	if (chain->jit_cost == 0) {
+		chain->jit_cost = cost;
+	} else {
+		chain->jit_cost = (chain->jit_cost * 7 + cost) / 8;
+		error = (int64_t) now - (int64_t) chain->jit_finish;
+		chain->jit_over[chain->frames & (SYNC_JIT_ERRORS - 1)] =
+			error <= 0 ? 0 : error > UINT32_MAX ? UINT32_MAX : error;
+	}
+
+	/* p99 is the smallest of the largest 1% and one */
+	for (i = 0; i < SYNC_JIT_ERRORS; i++) {
+		over = chain->jit_over[i];
+		for (j = 0; j < sizeof(top) / sizeof(top[0]) && over > top[j]; j++) {
+			if (j > 0)
+				top[j - 1] = top[j];
+			top[j] = over;
+		}
+	}
+
+	margin = top[0];
+	if (margin < sync_data.jit_margin)
+		margin = sync_data.jit_margin;
+	if (margin < chain->vblank_margin)
+		margin = chain->vblank_margin;
+
+	start = chain->deadline - chain->jit_cost - margin;
+	if (chain->deadline > chain->jit_cost + margin && start > now)
+		sync_wait_until(start);
+	else
+		start = now;
+	chain->jit_finish = start + chain->jit_cost;
+
+	frame->margin_ns = margin;
+	frame->error_ns = error;
+}
+
+/**
+ * \brief finds out whether vblanks of chain's drawable can be predicted
+ *
+ * Called on the first swap of a GLX chain in vblank mode. Chains without
+ * GLX_OML_sync_control fall back to jit mode with GLSYNC_FPS, or to plain
+ * fence mode without it.
+ */
+static void sync_vblank_init(struct sync_chain_s *chain, const struct sync_swap_s *swap)
+{
+	static int warned;
+	int32_t num, den;
+
+	if (swap->func == SYNC_SWAP_GLX && sync_data.glXGetSyncValuesOML &&
+	    sync_data.glXGetMscRateOML(swap->dpy, swap->drawable, &num, &den) && num > 0 && den > 0)
+		chain->refresh = 1000000000ull * den / num;
+
+	if (chain->refresh == 0 && !__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED))
+		fprintf(stderr, "glsync: no GLX_OML_sync_control, vblank mode falls back to %s\n",
+			__atomic_load_n(&sync_data.frame_interval, __ATOMIC_RELAXED) ? "jit" : "fence");
+}
+
+/**
+ * \brief sets jit deadline to the vblank the next frame should be shown at
+ *
+ * The swap waits for the frame it submitted, so the jit cost includes its
+ * GPU time and the next frame is started just in time to make the vblank.
+ * The last vblank reported by glXGetSyncValuesOML() anchors a grid of
+ * refresh periods. The frame just waited for is shown on the first vblank
+ * ahead, or was on the last one if the swap buffer count says so, which
+ * tells a frame that missed its vblank from a wakeup that came late. The
+ * next one is due the swap interval later, or the smallest multiple of
+ * the refresh period covering GLSYNC_FPS. A late frame thus costs one
+ * refresh and never a burst of catch-up frames.
+ * \param now time the fence wait finished
+ * \return 0 on success, nonzero if vblanks can't be predicted
+ */
+static int sync_vblank(struct sync_chain_s *chain, const struct sync_swap_s *swap, uint64_t now,
+		       uint64_t frame_interval)
+{
+	uint64_t period = chain->refresh, interval, vblank, next;
+	int64_t ust, msc, sbc;
+
+	if (period == 0 || !sync_data.glXGetSyncValuesOML(swap->dpy, swap->drawable, &ust, &msc, &sbc))
+		return 1;
+
+	/* UST is CLOCK_MONOTONIC in microseconds on Linux, check anyway */
+	vblank = (uint64_t) ust * 1000;
+	if (ust <= 0 || vblank > now + SYNC_MAX_UST_SKEW_NS || now > vblank + SYNC_MAX_UST_SKEW_NS) {
+		fprintf(stderr, "glsync: UST is not CLOCK_MONOTONIC, vblank mode disabled\n");
+		chain->refresh = 0;
+		return 1;
+	}
+
+	/* 60 fps on a 59.94 Hz display is every refresh, not every other */
+	interval = period * (sync_data.interval > 1 ? sync_data.interval : 1);
+	if (frame_interval > interval)
+		interval = (frame_interval - period / 16 + period - 1) / period * period;
+
+	/* one more frame swapped, minus the ones shown since the last swap */
+	chain->vblank_pending++;
+	if (chain->deadline && sbc > chain->vblank_sbc)
+		chain->vblank_pending -= sbc - chain->vblank_sbc;
+	if (chain->vblank_pending < 0)
+		chain->vblank_pending = 0;
+	chain->vblank_sbc = sbc;
+
+	if (chain->vblank_pending == 0) {
+		/* already shown, a late wakeup is no missed vblank */
+		chain->vblank_margin -= chain->vblank_margin / 256;
+		chain->deadline = vblank + interval;
+		return 0;
+	}
+
+	/*
+	 A missed vblank costs a whole refresh, not just the overshoot, so
+	 each miss raises the margin by 1/16 refresh and hits wear that off
+	 slowly.
+	*/
+	if (chain->deadline && now > chain->deadline + SYNC_VBLANK_SLACK_NS) {
+		chain->vblank_margin += period / 16;
+		if (chain->vblank_margin > period / 2)
+			chain->vblank_margin = period / 2;
+	} else
+		chain->vblank_margin -= chain->vblank_margin / 256;
+
+	/* frame that was just waited for is shown there, wakeup latency aside */
+	if (now > SYNC_VBLANK_SLACK_NS)
+		now -= SYNC_VBLANK_SLACK_NS;
+	next = now < vblank ? vblank : vblank + ((now - vblank) / period + 1) * period;
+
+	chain->deadline = next + interval;
+	return 0;
+}
+
+/**
+ * \brief doubles a depth controller cooldown
+ */
+static unsigned int sync_depth_backoff(unsigned int cooldown)
+{
+	return cooldown * 2 > SYNC_DEPTH_MAX_COOLDOWN ? SYNC_DEPTH_MAX_COOLDOWN : cooldown * 2;
+}
+
+/**
+ * \brief tells whether one frame less in flight would cost within the band
+ *
+ * Any depth above 0 lets the application build a frame while the GPU
+ * renders the one before, depth 0 runs them one after the other and adds
+ * the shorter of CPU and GPU time to every frame. GPU time is only known
+ * from timer queries, without them it may fill the whole frame.
+ */
+static int sync_depth_down_cheap(const struct sync_chain_s *chain)
+{
+	const struct sync_depth_s *d = &chain->depth;
+	uint64_t gpu = chain->queries.gpu_frame ? chain->queries.gpu_time : d->frame_avg;
+
+	if (d->depth > 1)
+		return 1;
+
+	return (d->cpu_avg < gpu ? d->cpu_avg : gpu) * 100 <= d->frame_avg * SYNC_DEPTH_BAND;
+}
+
+/**
+ * \brief feeds one frame to the depth controller
+ *
+ * Every SYNC_DEPTH_WINDOW frames one decision is taken:
+ * - latency (application CPU time plus swap to GPU completion) above
+ *   GLSYNC_LATENCY_US takes a frame out of flight;
+ * - a running trial is kept only if it did not cost more than
+ *   SYNC_DEPTH_BAND percent of frame time, and for a step up only if it
+ *   gained that much,
+ *   otherwise it is undone and that direction rests SYNC_DEPTH_COOLDOWN
+ *   windows, twice as long after every further undo in a row;
+ * - stalls above 1/8 of frame time mean the application waits for the
+ *   GPU and one more frame is tried, unless that would break the
+ *   ceiling or was just undone, in which case one less is tried, since
+ *   a saturated GPU gains nothing from the extra frame;
+ * - stalls below 1/32 of frame time mean the last frame in flight is not
+ *   used and one less is tried.
+ * One less is only tried if sync_depth_down_cheap() says CPU and GPU stay
+ * overlapped, or what depth 0 serializes fits in the band, otherwise the
+ * trial could only be undone.
+ * The bands and the cooldown keep depth from flapping.
+ * \param stall_ns time in fence waits and the real swap, which blocks when
+ *        the driver's own queue is full
+ * \param gpu time from swap entry to completion of the frame retired by
+ *        this swap, an upper bound if it was not waited for, 0 if none
+ * \return decision, chain->depth.depth is the depth from now on
+ */
+static enum glsync_depth_decision_e sync_depth_update(struct sync_chain_s *chain, uint64_t frame_ns,
+						      uint64_t cpu_ns, uint64_t stall_ns, uint64_t gpu)
+{
+	struct sync_depth_s *d = &chain->depth;
+	enum glsync_depth_decision_e decision = GLSYNC_DEPTH_KEEP;
+	uint64_t latency, mean;
+
+	/* first frame of a chain has no previous one to measure against */
+	if (frame_ns == 0)
+		return GLSYNC_DEPTH_KEEP;
+
+	if (d->frame_avg == 0) {
+		d->frame_avg = frame_ns;
+		d->cpu_avg = cpu_ns;
+		d->wait_avg = stall_ns;
+	} else {
+		d->frame_avg = (d->frame_avg * 7 + frame_ns) / 8;
+		d->cpu_avg = (d->cpu_avg * 7 + cpu_ns) / 8;
+		d->wait_avg = (d->wait_avg * 7 + stall_ns) / 8;
+	}
+	if (gpu)
+		d->gpu_avg = d->gpu_avg ? (d->gpu_avg * 7 + gpu) / 8 : gpu;
+
+	d->window_sum += frame_ns;
+	if (--d->countdown > 0)
+		return GLSYNC_DEPTH_KEEP;
+	d->countdown = SYNC_DEPTH_WINDOW;
+	mean = d->window_sum / SYNC_DEPTH_WINDOW;
+	d->window_sum = 0;
+
+	if (d->cooldown_up)
+		d->cooldown_up--;
+	if (d->cooldown_down)
+		d->cooldown_down--;
+
+	latency = d->cpu_avg + d->gpu_avg;
+
+	if (sync_data.latency && latency > sync_data.latency && d->depth > sync_data.depth_min) {
+		d->depth--;
+		d->trial = GLSYNC_DEPTH_KEEP;
+		d->cooldown_up = SYNC_DEPTH_COOLDOWN;
+		decision = GLSYNC_DEPTH_CEILING;
+	} else if (d->trial == GLSYNC_DEPTH_UP) {
+		if (mean * 100 > d->baseline * (100 - SYNC_DEPTH_BAND)) {
+			d->depth--;
+			d->cooldown_up = d->backoff_up;
+			d->backoff_up = sync_depth_backoff(d->backoff_up);
+			decision = GLSYNC_DEPTH_REVERT;
+		} else
+			d->backoff_up = SYNC_DEPTH_COOLDOWN;
+		d->trial = GLSYNC_DEPTH_KEEP;
+	} else if (d->trial == GLSYNC_DEPTH_DOWN) {
+		if (mean * 100 > d->baseline * (100 + SYNC_DEPTH_BAND)) {
+			d->depth++;
+			d->cooldown_down = d->backoff_down;
+			d->backoff_down = sync_depth_backoff(d->backoff_down);
+			decision = GLSYNC_DEPTH_REVERT;
+		} else
+			d->backoff_down = SYNC_DEPTH_COOLDOWN;
+		d->trial = GLSYNC_DEPTH_KEEP;
+	} else if (d->wait_avg > d->frame_avg / 8) {
+		if (d->depth < sync_data.depth_max && !d->cooldown_up &&
+		    (!sync_data.latency || latency + d->frame_avg <= sync_data.latency)) {
+			d->depth++;
+			decision = d->trial = GLSYNC_DEPTH_UP;
+		} else if (d->depth > sync_data.depth_min && !d->cooldown_down && sync_depth_down_cheap(chain)) {
+			d->depth--;
+			decision = d->trial = GLSYNC_DEPTH_DOWN;
+		}
+	} else if (d->wait_avg < d->frame_avg / 32 && d->depth > sync_data.depth_min && !d->cooldown_down &&
+		   sync_depth_down_cheap(chain)) {
+		d->depth--;
+		decision = d->trial = GLSYNC_DEPTH_DOWN;
+	}
+
+	d->baseline = mean;
+
+	return decision;
+}
+
+/**
+ * \brief closes GPU time measurement of the frame being swapped
+ *
+ * Also collects results that are ready. Availability is checked from the
+ * oldest pair and stops at the first that is not done, nothing here waits
+ * for the GPU.
+ */
+static void sync_queries_end(struct sync_queries_s *q, uint64_t frame)
+{
+	GLuint64 start, end;
+	GLint avail;
+	unsigned int i;
+
+	if (q->open) {
+		i = (q->head + q->count) % SYNC_MAX_QUERIES;
+		sync_data.glQueryCounter(q->end[i], GL_TIMESTAMP);
+		q->frame[i] = frame;
+		q->count++;
+		q->open = 0;
+	}
+
+	while (q->count) {
+		i = q->head;
+		sync_data.glGetQueryObjectiv(q->end[i], GL_QUERY_RESULT_AVAILABLE, &avail);
+		if (!avail)
+			break;
+
+		sync_data.glGetQueryObjectui64v(q->start[i], GL_QUERY_RESULT, &start);
+		sync_data.glGetQueryObjectui64v(q->end[i], GL_QUERY_RESULT, &end);
+		q->gpu_time = end > start ? end - start : 0;
+		q->gpu_frame = q->frame[i];
+
+		q->head = (q->head + 1) % SYNC_MAX_QUERIES;
+		q->count--;
+	}
+}
+
+/**
+ * \brief starts GPU time measurement of the next frame
+ *
+ * Frames are skipped while all pairs wait for results.
+ */
+static void sync_queries_start(struct sync_queries_s *q)
+{
+	if (q->start[0] == 0) {
+		sync_data.glGenQueries(SYNC_MAX_QUERIES, q->start);
+		sync_data.glGenQueries(SYNC_MAX_QUERIES, q->end);
+	}
+
+	if (q->count == SYNC_MAX_QUERIES)
+		return;
+
+	sync_data.glQueryCounter(q->start[(q->head + q->count) % SYNC_MAX_QUERIES], GL_TIMESTAMP);
+	q->open = 1;
+}
+
+/**
+ * \brief deletes query objects, context that created them must be current
+ */
+static void sync_queries_destroy(struct sync_queries_s *q)
+{
+	if (q->start[0] == 0)
+		return;
+
+	sync_data.glDeleteQueries(SYNC_MAX_QUERIES, q->start);
+	sync_data.glDeleteQueries(SYNC_MAX_QUERIES, q->end);
+}
+
+/**
+ * \brief starts depth of a chain at the configured one
+ */
+static void sync_depth_init(struct sync_depth_s *d)
+{
+	memset(d, 0, sizeof(struct sync_depth_s));
+	d->enabled = __atomic_load_n(&sync_data.depth_auto, __ATOMIC_RELAXED);
+	d->depth = __atomic_load_n(&sync_data.depth, __ATOMIC_RELAXED);
+	d->countdown = SYNC_DEPTH_WINDOW;
+	d->backoff_up = SYNC_DEPTH_COOLDOWN;
+	d->backoff_down = SYNC_DEPTH_COOLDOWN;
+}
+
+/**
+ * \brief sets up new chain for current context
+ *
+ * EGL chains use EGL fences if the display has them and GL sync objects
+ * otherwise. Timer queries and KHR_debug are used with desktop GL only.
+ */
+static void sync_chain_init(struct sync_chain_s *chain, enum sync_api_e api, void *dpy, void *ctx)
+{
+	int desktop_gl = 1;
+
+	memset(chain, 0, sizeof(struct sync_chain_s));
+
+	chain->ring.kind = sync_data.glFenceSync ? SYNC_FENCE_GL : SYNC_FENCE_NONE;
+	if (api == SYNC_API_EGL) {
+		const char *ext = sync_data.eglQueryString(dpy, EGL_EXTENSIONS);
+
+		if (sync_data.eglCreateSyncKHR && ext && strstr(ext, "EGL_KHR_fence_sync")) {
+			chain->ring.kind = SYNC_FENCE_EGL;
+			chain->ring.dpy = dpy;
+		}
+
+		desktop_gl = sync_data.eglQueryAPI() == EGL_OPENGL_API;
+	}
+
+	chain->gputime = sync_data.gputime && desktop_gl;
+	if (sync_data.debug && desktop_gl)
+		sync_debug_attach();
+
+	chain->ring.waiter = sync_waiter_get(api, dpy, ctx, chain->ring.kind);
+
+	sync_depth_init(&chain->depth);
+	chain->generation = __atomic_load_n(&sync_control.generation, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * \brief brings chain up to settings changed through GLSYNC_CONTROL
+ *
+ * Limiter and jit deadlines start over, and so does the depth controller
+ * unless it was running already and still is.
+ */
+static void sync_chain_retune(struct sync_chain_s *chain)
+{
+	chain->generation = __atomic_load_n(&sync_control.generation, __ATOMIC_ACQUIRE);
+	chain->deadline = 0;
+	if (!__atomic_load_n(&sync_data.depth_auto, __ATOMIC_RELAXED) || !chain->depth.enabled)
+		sync_depth_init(&chain->depth);
+}
+
+/**
+ * \brief finds or allocates state for given chain
+ *
+ * When the table is full the least recently swapped chain is evicted. Its
+ * fences are deleted only if they belong to the current context, fences of
+ * other contexts are abandoned rather than touched from the wrong context.
+ */
+static struct sync_chain_s *sync_chain_get(struct sync_chains_s *chains, enum sync_api_e api,
+					   void *dpy, void *ctx, unsigned long drawable)
+{
+	unsigned int i, slot;
+
+	chains->swaps++;
+
+	i = chains->last;
+	if (chains->key[i].ctx == ctx && chains->key[i].drawable == drawable) {
+		chains->last_use[i] = chains->swaps;
+		return &chains->chain[i];
+	}
+
+	slot = 0;
+	for (i = 0; i < SYNC_MAX_CHAINS; i++) {
+		if (chains->key[i].ctx == ctx && chains->key[i].drawable == drawable) {
+			chains->last = i;
+			chains->last_use[i] = chains->swaps;
+			return &chains->chain[i];
+		}
+
+		if (chains->key[slot].ctx != NULL &&
+		    (chains->key[i].ctx == NULL || chains->last_use[i] < chains->last_use[slot]))
+			slot = i;
+	}
+
+	if (chains->key[slot].ctx == ctx) {
+		sync_ring_retire(&chains->chain[slot].ring, 0);
+		sync_queries_destroy(&chains->chain[slot].queries);
+	}
+
+	sync_chain_init(&chains->chain[slot], api, dpy, ctx);
+	chains->key[slot].ctx = ctx;
+	chains->key[slot].drawable = drawable;
+	chains->last_use[slot] = chains->swaps;
+	chains->last = slot;
+
+	return &chains->chain[slot];
+}
+
+/**
+ * \brief deletes fences without waiting for them
+ * \return number of fences deleted
+ */
+static unsigned int sync_ring_drop(struct sync_ring_s *ring)
+{
+	unsigned int n = ring->count;
+
+	while (ring->count) {
+		/* waiter deletes its own */
+		if (!ring->waiter)
+			sync_fence_delete(ring, ring->fence[ring->head]);
+		ring->head = (ring->head + 1) % (SYNC_MAX_DEPTH + 1);
+		ring->count--;
+	}
+
+	return n;
+}
+
+/**
+ * \brief forgets all chains of given context
+ *
+ * GL objects can only be deleted while their context is current, otherwise
+ * they are left for the context to free. EGL fences belong to the display
+ * and are always destroyed.
+ * \param live ctx is alive and current in calling thread
+ */
+static void sync_chains_forget(struct sync_chains_s *chains, void *ctx, int live)
+{
+	struct glsync_telemetry_s *tm = __atomic_load_n(&sync_data.telemetry, __ATOMIC_ACQUIRE);
+	unsigned int i, dropped = 0;
+
+	for (i = 0; i < SYNC_MAX_CHAINS; i++) {
+		if (chains->key[i].ctx != ctx)
+			continue;
+
+		if (live || chains->chain[i].ring.kind == SYNC_FENCE_EGL)
+			dropped += sync_ring_drop(&chains->chain[i].ring);
+		if (live)
+			sync_queries_destroy(&chains->chain[i].queries);
+
+		memset(&chains->chain[i], 0, sizeof(struct sync_chain_s));
+		chains->key[i].ctx = NULL;
+		chains->key[i].drawable = 0;
+		chains->last_use[i] = 0;
+	}
+
+	if (tm && dropped)
+		__atomic_fetch_add(&tm->fences_dropped, dropped, __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief forgets chains of contexts destroyed since last check
+ *
+ * One atomic load when nothing was destroyed. A thread that fell more than
+ * SYNC_MAX_DESTROYED contexts behind forgets everything.
+ */
+static void sync_chains_update(struct sync_chains_s *chains)
+{
+	unsigned long epoch, e;
+	unsigned int i;
+
+	epoch = __atomic_load_n(&sync_destroyed.epoch, __ATOMIC_ACQUIRE);
+	if (epoch == chains->epoch)
+		return;
+
+	pthread_mutex_lock(&sync_destroyed.mutex);
+	epoch = sync_destroyed.epoch;
+	if (epoch - chains->epoch > SYNC_MAX_DESTROYED) {
+		for (i = 0; i < SYNC_MAX_CHAINS; i++) {
+			if (chains->key[i].ctx != NULL)
+				sync_chains_forget(chains, chains->key[i].ctx, 0);
+		}
+	} else {
+		for (e = chains->epoch; e != epoch; e++)
+			sync_chains_forget(chains, sync_destroyed.ctx[e % SYNC_MAX_DESTROYED], 0);
+	}
+	pthread_mutex_unlock(&sync_destroyed.mutex);
+
+	chains->epoch = epoch;
+}
+
+/**
+ * \brief drops fence state of a context that is about to be destroyed
+ * \param current context current in calling thread
+ */
+static void sync_context_destroy(void *ctx, void *current)
+{
+	struct glsync_telemetry_s *tm = __atomic_load_n(&sync_data.telemetry, __ATOMIC_ACQUIRE);
+
+	if (ctx == NULL)
+		return;
+
+	/* own chains first, while their objects can still be deleted */
+	sync_chains_update(&sync_chains);
+	sync_chains_forget(&sync_chains, ctx, ctx == current);
+	sync_waiter_stop(ctx);
+
+	pthread_mutex_lock(&sync_destroyed.mutex);
+	sync_destroyed.ctx[sync_destroyed.epoch % SYNC_MAX_DESTROYED] = ctx;
+	__atomic_store_n(&sync_destroyed.epoch, sync_destroyed.epoch + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&sync_destroyed.mutex);
+
+	/* our own table has already seen it */
+	if (sync_chains.epoch + 1 == sync_destroyed.epoch)
+		sync_chains.epoch++;
+
+	if (tm)
+		__atomic_fetch_add(&tm->ctx_destroyed, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief counts context switches
+ */
+static void sync_context_switch(void *ctx, void *current)
+{
+	struct glsync_telemetry_s *tm = __atomic_load_n(&sync_data.telemetry, __ATOMIC_ACQUIRE);
+
+	if (tm && ctx != current)
+		__atomic_fetch_add(&tm->ctx_switches, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief sets GLSYNC_SWAP_INTERVAL on a drawable the application swaps
+ *
+ * Applications that never set the interval get it on their first swap,
+ * through whichever swap control extension is available.
+ */
+static void sync_swap_interval_force(Display *dpy, GLXDrawable drawable)
+{
+	int interval = sync_data.swap_interval;
+
+	if (sync_data.glXSwapIntervalEXT)
+		sync_data.glXSwapIntervalEXT(dpy, drawable, interval);
+	else if (sync_data.glXSwapIntervalMESA)
+		sync_data.glXSwapIntervalMESA(interval);
+	else if (sync_data.glXSwapIntervalSGI && interval > 0)
+		sync_data.glXSwapIntervalSGI(interval);
+}
+
+/**
+ * \brief replaces interval the application asks for with the forced one
+ */
+static int sync_swap_interval(int interval)
+{
+	if (sync_data.swap_interval != SYNC_SWAP_INTERVAL_APP)
+		interval = sync_data.swap_interval;
+
+	__atomic_store_n(&sync_data.interval, interval, __ATOMIC_RELAXED);
+	return interval;
+}
+
+/**
+ * \brief calls the real swap function described by swap
+ */
+static EGLBoolean sync_swap_real(const struct sync_swap_s *swap)
+{
+	switch (swap->func) {
+	case SYNC_SWAP_GLX:
+		sync_data.glXSwapBuffers(swap->dpy, swap->drawable);
+		return EGL_TRUE;
+	case SYNC_SWAP_EGL:
+		return sync_data.eglSwapBuffers(swap->dpy, (EGLSurface) swap->drawable);
+	case SYNC_SWAP_EGL_DAMAGE_KHR:
+		if (sync_data.eglSwapBuffersWithDamageKHR == NULL)
+			break;
+		return sync_data.eglSwapBuffersWithDamageKHR(swap->dpy, (EGLSurface) swap->drawable,
+							     swap->rects, swap->nrects);
+	case SYNC_SWAP_EGL_DAMAGE_EXT:
+		if (sync_data.eglSwapBuffersWithDamageEXT == NULL)
+			break;
+		return sync_data.eglSwapBuffersWithDamageEXT(swap->dpy, (EGLSurface) swap->drawable,
+							     (EGLint *) swap->rects, swap->nrects);
+	}
+
+	/* damage is only a hint */
+	return sync_data.eglSwapBuffers(swap->dpy, (EGLSurface) swap->drawable);
+}
+
+/**
+ * \brief swaps and enforces sync with fence objects.
+ *
+ * Every frame gets a fence. Once more than sync_data.depth fences are
+ * pending, the oldest ones are waited for, so depth 0 waits for the frame
+ * that was just submitted and depth N lets N frames queue up on the GPU.
+ * The frame rate limiter runs after the fence wait, so it paces frames
+ * by when the GPU finished them rather than when they were submitted.
+ * In jit mode the wait is moved in front of the next frame instead, and
+ * vblank mode puts jit deadlines on predicted vblanks.
+ * Fences are tracked per (context, drawable) so several windows are paced
+ * independently of each other.
+ */
+static EGLBoolean sync_swap(const struct sync_swap_s *swap, void *ctx)
+{
+	enum sync_api_e api = swap->func == SYNC_SWAP_GLX ? SYNC_API_GLX : SYNC_API_EGL;
+	struct glsync_telemetry_s *tm;
+	struct sync_chain_s *chain;
+	struct glsync_frame_s frame;
+	uint64_t fenced, swapped, waited, retired, done, cpu, cputime = 0, interval;
+	enum glsync_depth_decision_e decision;
+	unsigned int keep;
+	EGLBoolean ret;
+	void *sync;
+
+	if (!sync_data.off)
+		pthread_once(&sync_swap_once, init_sync_swap);
+	if (sync_control.block)
+		sync_control_poll();
+
+	/* nothing to fence without a context */
+	if (ctx == NULL || sync_data.off)
+		return sync_swap_real(swap);
+
+	/* settings can change under us, the whole frame sees one snapshot */
+	tm = __atomic_load_n(&sync_data.telemetry, __ATOMIC_ACQUIRE);
+	interval = __atomic_load_n(&sync_data.frame_interval, __ATOMIC_RELAXED);
+
+	frame.time = sync_now();
+	frame.margin_ns = 0;
+	frame.error_ns = 0;
+	frame.wait_cpu_ns = 0;
+
+	sync_chains_update(&sync_chains);
+	chain = sync_chain_get(&sync_chains, api, swap->dpy, ctx, swap->drawable);
+	if (chain->generation != __atomic_load_n(&sync_control.generation, __ATOMIC_ACQUIRE))
+		sync_chain_retune(chain);
+	chain->frames++;
+	if (chain->frames == 1) {
+		if (api == SYNC_API_GLX && sync_data.swap_interval != SYNC_SWAP_INTERVAL_APP)
+			sync_swap_interval_force(swap->dpy, swap->drawable);
+		if (sync_data.mode == SYNC_MODE_VBLANK)
+			sync_vblank_init(chain, swap);
+	}
+	if (chain->gputime)
+		sync_queries_end(&chain->queries, chain->frames);
+
+	sync = sync_fence_create(&chain->ring);
+	fenced = sync_now();
+	ret = sync_swap_real(swap);
+	swapped = sync_now();
+
+	if (sync)
+		sync_ring_push(&chain->ring, sync, frame.time);
+
+	/* vblank deadlines are met by the frame itself, not depth frames later */
+	keep = sync_data.mode == SYNC_MODE_VBLANK && chain->refresh ? 0 : chain->depth.depth;
+
+	/* CPU clock is a syscall, only read it if someone is looking */
+	if (tm)
+		cputime = sync_thread_cputime();
+	retired = sync_ring_retire(&chain->ring, keep);
+	waited = sync_now();
+	if (tm)
+		frame.wait_cpu_ns = sync_thread_cputime() - cputime;
+
+	cpu = chain->last_exit ? frame.time - chain->last_exit : 0;
+
+	decision = GLSYNC_DEPTH_KEEP;
+	if (chain->depth.enabled)
+		decision = sync_depth_update(chain, chain->last_entry ? frame.time - chain->last_entry : 0,
+					     cpu, waited - fenced, retired ? waited - retired : 0);
+
+	if (sync_data.mode == SYNC_MODE_VBLANK && !sync_vblank(chain, swap, waited, interval)) {
+		sync_jit(chain, waited, cpu + (waited - swapped), &frame);
+		done = sync_now();
+	} else if (sync_data.mode != SYNC_MODE_FENCE && interval) {
+		sync_jit_deadline(chain, waited, interval);
+		sync_jit(chain, waited, cpu + (waited - swapped), &frame);
+		done = sync_now();
+	} else if (interval) {
+		sync_limit(chain, waited, interval);
+		done = sync_now();
+	} else
+		done = waited;
+
+	if (tm) {
+		frame.chain = swap->drawable;
+		frame.frame_ns = chain->last_entry ? frame.time - chain->last_entry : 0;
+		frame.cpu_ns = cpu;
+		frame.swap_ns = swapped - fenced;
+		frame.wait_ns = waited - swapped;
+		frame.limit_ns = done - waited;
+		frame.depth = decision == GLSYNC_DEPTH_KEEP ? keep : chain->depth.depth;
+		frame.decision = decision;
+		frame.latency_ns = chain->depth.cpu_avg + chain->depth.gpu_avg;
+		if (decision != GLSYNC_DEPTH_KEEP)
+			__atomic_fetch_add(&tm->depth_changes, 1, __ATOMIC_RELAXED);
+		if (chain->queries.gpu_frame != chain->queries.reported) {
+			frame.gpu_ns = chain->queries.gpu_time;
+			frame.gpu_age = chain->frames - chain->queries.gpu_frame;
+			chain->queries.reported = chain->queries.gpu_frame;
+		} else {
+			frame.gpu_ns = 0;
+			frame.gpu_age = 0;
+		}
+		sync_telemetry_push(tm, &frame);
+	}
+
+	/* recorded last, everything the application submits from now on is the next frame */
+	if (chain->gputime)
+		sync_queries_start(&chain->queries);
+
+	chain->last_entry = frame.time;
+	chain->last_exit = done;
+
+	return ret;
+}
+
+/**
+ * \brief wrapped glXSwapBuffers that enforces sync with fence object.
+ */
+void sync_glXSwapBuffers(Display* dpy, GLXDrawable drawable)
+{
+	struct sync_swap_s swap = { SYNC_SWAP_GLX, dpy, drawable, NULL, 0 };
+
+	sync_init_gl();
+	sync_swap(&swap, sync_data.glXGetCurrentContext());
+}
+
+/**
+ * \brief wrapped eglSwapBuffers that enforces sync with fence object.
+ */
+EGLBoolean sync_eglSwapBuffers(EGLDisplay dpy, EGLSurface surface)
+{
+	struct sync_swap_s swap = { SYNC_SWAP_EGL, dpy, (unsigned long) surface, NULL, 0 };
+
+	sync_init_egl();
+	return sync_swap(&swap, sync_data.eglGetCurrentContext());
+}
+
+/**
+ * \brief wrapped eglSwapBuffersWithDamageKHR
+ */
+EGLBoolean sync_eglSwapBuffersWithDamageKHR(EGLDisplay dpy, EGLSurface surface,
+					    const EGLint *rects, EGLint nrects)
+{
+	struct sync_swap_s swap = { SYNC_SWAP_EGL_DAMAGE_KHR, dpy, (unsigned long) surface, rects, nrects };
+
+	sync_init_egl();
+	return sync_swap(&swap, sync_data.eglGetCurrentContext());
+}
+
+/**
+ * \brief wrapped eglSwapBuffersWithDamageEXT
+ */
+EGLBoolean sync_eglSwapBuffersWithDamageEXT(EGLDisplay dpy, EGLSurface surface,
+					    const EGLint *rects, EGLint nrects)
+{
+	struct sync_swap_s swap = { SYNC_SWAP_EGL_DAMAGE_EXT, dpy, (unsigned long) surface, rects, nrects };
+
+	sync_init_egl();
+	return sync_swap(&swap, sync_data.eglGetCurrentContext());
+}
+
+/**
+ * \brief wrapped glXSwapIntervalEXT, enforces GLSYNC_SWAP_INTERVAL
+ */
+void sync_glXSwapIntervalEXT(Display *dpy, GLXDrawable drawable, int interval)
+{
+	sync_init_gl();
+	interval = sync_swap_interval(interval);
+	if (sync_data.glXSwapIntervalEXT)
+		sync_data.glXSwapIntervalEXT(dpy, drawable, interval);
+}
+
+/**
+ * \brief wrapped glXSwapIntervalMESA, enforces GLSYNC_SWAP_INTERVAL
  */
+int sync_glXSwapIntervalMESA(unsigned int interval)
+{
+	sync_init_gl();
+	interval = sync_swap_interval(interval);
+	if (sync_data.glXSwapIntervalMESA == NULL)
+		return GLX_BAD_CONTEXT;
+	return sync_data.glXSwapIntervalMESA(interval);
+}
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <GL/glx.h>
-#include <sys/time.h>
-#include <elfhacks.h>
+/**
+ * \brief wrapped glXSwapIntervalSGI, enforces GLSYNC_SWAP_INTERVAL
+ *
+ * SGI_swap_control can't turn vsync off, so a forced 0 is not passed on.
+ */
+int sync_glXSwapIntervalSGI(int interval)
+{
+	sync_init_gl();
+	interval = sync_swap_interval(interval);
+	if (sync_data.glXSwapIntervalSGI == NULL)
+		return GLX_BAD_CONTEXT;
+	return interval > 0 ? sync_data.glXSwapIntervalSGI(interval) : 0;
+}
 
-typedef void (*GLXextFuncPtr)(void);
+/**
+ * \brief wrapped glXMakeCurrent
+ */
+Bool sync_glXMakeCurrent(Display* dpy, GLXDrawable drawable, GLXContext ctx)
+{
+	sync_init_gl();
+	sync_context_switch(ctx, sync_data.glXGetCurrentContext());
+	return sync_data.glXMakeCurrent(dpy, drawable, ctx);
+}
 
 /**
- * \brief sync private data struct
+ * \brief wrapped glXMakeContextCurrent
  */
-struct sync_data_s {
-	/** pointer to real dlsym() */
-	void *(*dlsym)(void*, const char*);
+Bool sync_glXMakeContextCurrent(Display* dpy, GLXDrawable draw, GLXDrawable read, GLXContext ctx)
+{
+	sync_init_gl();
+	sync_context_switch(ctx, sync_data.glXGetCurrentContext());
+	return sync_data.glXMakeContextCurrent(dpy, draw, read, ctx);
+}
 
-	/** pointer to real dlvsym() */
-	void *(*dlvsym)(void*, const char*, const char*);
+/**
+ * \brief wrapped glXDestroyContext that drops fence state of ctx
+ */
+void sync_glXDestroyContext(Display* dpy, GLXContext ctx)
+{
+	sync_init_gl();
+	sync_context_destroy(ctx, sync_data.glXGetCurrentContext());
+	sync_data.glXDestroyContext(dpy, ctx);
+}
 
-	/** pointer to real glXGetProcAddressARB() */
-	GLXextFuncPtr (*glXGetProcAddressARB)(const GLubyte*);
+/**
+ * \brief wrapped eglMakeCurrent
+ */
+EGLBoolean sync_eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx)
+{
+	sync_init_egl();
+	sync_context_switch(ctx, sync_data.eglGetCurrentContext());
+	return sync_data.eglMakeCurrent(dpy, draw, read, ctx);
+}
 
-	/** pointer to real glXSwapBuffers() */
-	void (*glXSwapBuffers)(Display*, GLXDrawable);
+/**
+ * \brief wrapped eglDestroyContext that drops fence state of ctx
+ */
+EGLBoolean sync_eglDestroyContext(EGLDisplay dpy, EGLContext ctx)
+{
+	sync_init_egl();
+	sync_context_destroy(ctx, sync_data.eglGetCurrentContext());
+	return sync_data.eglDestroyContext(dpy, ctx);
+}
+
+GLXextFuncPtr sync_glXGetProcAddressARB(const GLubyte *proc_name);
+EGLextFuncPtr sync_eglGetProcAddress(const char *proc_name);
+void *sync_dlopen(const char *filename, int flag);
+int sync_dlclose(void *handle);
+
+/**
+ * \brief intercepted functions, one line each
+ */
+static const struct sync_hook_s sync_hooks[] = {
+	{ "glXSwapBuffers", (void *) &sync_glXSwapBuffers, SYNC_HOOK_DL | SYNC_HOOK_GLX | SYNC_HOOK_GOT, NULL },
+	{ "glXGetProcAddressARB", (void *) &sync_glXGetProcAddressARB, SYNC_HOOK_DL | SYNC_HOOK_GLX | SYNC_HOOK_GOT, NULL },
+	{ "glXGetProcAddress", (void *) &sync_glXGetProcAddressARB, SYNC_HOOK_DL | SYNC_HOOK_GLX | SYNC_HOOK_GOT, NULL },
+	{ "glXMakeCurrent", (void *) &sync_glXMakeCurrent, SYNC_HOOK_DL | SYNC_HOOK_GLX | SYNC_HOOK_GOT, NULL },
+	{ "glXMakeContextCurrent", (void *) &sync_glXMakeContextCurrent, SYNC_HOOK_DL | SYNC_HOOK_GLX | SYNC_HOOK_GOT, NULL },
+	{ "glXDestroyContext", (void *) &sync_glXDestroyContext, SYNC_HOOK_DL | SYNC_HOOK_GLX | SYNC_HOOK_GOT, NULL },
+	{ "glXSwapIntervalEXT", (void *) &sync_glXSwapIntervalEXT, SYNC_HOOK_DL | SYNC_HOOK_GLX | SYNC_HOOK_GOT,
+	  (void **) &sync_data.glXSwapIntervalEXT },
+	{ "glXSwapIntervalMESA", (void *) &sync_glXSwapIntervalMESA, SYNC_HOOK_DL | SYNC_HOOK_GLX | SYNC_HOOK_GOT,
+	  (void **) &sync_data.glXSwapIntervalMESA },
+	{ "glXSwapIntervalSGI", (void *) &sync_glXSwapIntervalSGI, SYNC_HOOK_DL | SYNC_HOOK_GLX | SYNC_HOOK_GOT,
+	  (void **) &sync_data.glXSwapIntervalSGI },
+	{ "eglSwapBuffers", (void *) &sync_eglSwapBuffers, SYNC_HOOK_DL | SYNC_HOOK_EGL | SYNC_HOOK_GOT, NULL },
+	{ "eglSwapBuffersWithDamageKHR", (void *) &sync_eglSwapBuffersWithDamageKHR, SYNC_HOOK_DL | SYNC_HOOK_EGL | SYNC_HOOK_GOT,
+	  (void **) &sync_data.eglSwapBuffersWithDamageKHR },
+	{ "eglSwapBuffersWithDamageEXT", (void *) &sync_eglSwapBuffersWithDamageEXT, SYNC_HOOK_DL | SYNC_HOOK_EGL | SYNC_HOOK_GOT,
+	  (void **) &sync_data.eglSwapBuffersWithDamageEXT },
+	{ "eglGetProcAddress", (void *) &sync_eglGetProcAddress, SYNC_HOOK_DL | SYNC_HOOK_EGL | SYNC_HOOK_GOT, NULL },
+	{ "eglMakeCurrent", (void *) &sync_eglMakeCurrent, SYNC_HOOK_DL | SYNC_HOOK_EGL | SYNC_HOOK_GOT, NULL },
+	{ "eglDestroyContext", (void *) &sync_eglDestroyContext, SYNC_HOOK_DL | SYNC_HOOK_EGL | SYNC_HOOK_GOT, NULL },
+	{ "dlopen", (void *) &sync_dlopen, SYNC_HOOK_GOT, NULL },
+	{ "dlclose", (void *) &sync_dlclose, SYNC_HOOK_GOT, NULL },
 };
 
-/** pointer to sync data structure */
-static struct sync_data_s *sync_data = NULL;
+#define SYNC_HOOKS (sizeof(sync_hooks) / sizeof(sync_hooks[0]))
+
+/** perfect hash index into sync_hooks, hook index + 1 or 0 */
+static unsigned char sync_hook_slot[1 << SYNC_HOOK_BITS];
+
+/** full hash of every hook name */
+static uint32_t sync_hook_hash[SYNC_HOOKS];
+
+/** multiplier that maps hook names to distinct slots */
+static uint32_t sync_hook_seed;
+
+/** guards init_sync_hooks() */
+static pthread_once_t sync_hooks_once = PTHREAD_ONCE_INIT;
 
 /**
- * \brief initializes sync_data
+ * \brief string hash used for hook names, same as DT_GNU_HASH
  */
-void init_sync_data()
+static uint32_t sync_hook_hash_name(const char *name)
 {
-	sync_data = malloc(sizeof(struct sync_data_s));
-	memset(sync_data, 0, sizeof(struct sync_data_s));
+	const unsigned char *p = (const unsigned char *) name;
+	uint32_t h = 5381;
 
-	/* get dlsym() and dlvsym() using elfhacks */
-	eh_obj_t libdl;
+	while (*p)
+		h = h * 33 + *p++;
 
-	if (eh_find_obj(&libdl, "*libdl.so*")) {
-		fprintf(stderr, "can't get libdl.so\n");
-		exit(1);
-	}
+	return h;
+}
 
-	if (eh_find_sym(&libdl, "dlsym", (void **) &sync_data->dlsym)) {
-		fprintf(stderr, "can't get dlsym()\n");
-		exit(1);
+/**
+ * \brief maps full hash to index slot
+ */
+static unsigned int sync_hook_slot_of(uint32_t hash, uint32_t seed)
+{
+	return (uint32_t) (hash * seed) >> (32 - SYNC_HOOK_BITS);
+}
+
+/**
+ * \brief finds a multiplier under which no two hook names share a slot
+ *
+ * A few dozen names in 64 slots, so some odd multiplier near the golden
+ * ratio works within the first few tries.
+ */
+static void init_sync_hooks(void)
+{
+	uint32_t seed;
+	unsigned int i, slot;
+
+	for (i = 0; i < SYNC_HOOKS; i++)
+		sync_hook_hash[i] = sync_hook_hash_name(sync_hooks[i].name);
+
+	for (seed = 0x9e3779b1; seed != 0x9e3779b1 + 2 * 4096; seed += 2) {
+		memset(sync_hook_slot, 0, sizeof(sync_hook_slot));
+		for (i = 0; i < SYNC_HOOKS; i++) {
+			slot = sync_hook_slot_of(sync_hook_hash[i], seed);
+			if (sync_hook_slot[slot])
+				break;
+			sync_hook_slot[slot] = i + 1;
+		}
+
+		if (i == SYNC_HOOKS) {
+			sync_hook_seed = seed;
+			return;
+		}
 	}
 
-	if (eh_find_sym(&libdl, "dlvsym", (void **) &sync_data->dlvsym)) {
-		fprintf(stderr, "can't get dlvsym()\n");
-		exit(1);
+	fprintf(stderr, "glsync: can't build hook index, raise SYNC_HOOK_BITS\n");
+	exit(1);
+}
+
+/**
+ * \brief looks up hook for symbol, one hash and one compare
+ * \param hash sync_hook_hash_name(name)
+ * \param flags SYNC_HOOK_* lookup being served
+ * \return replacement or NULL if symbol is not intercepted
+ */
+static void *sync_hook_find(const char *name, uint32_t hash, unsigned int flags)
+{
+	const struct sync_hook_s *hook;
+	unsigned int i;
+
+	pthread_once(&sync_hooks_once, init_sync_hooks);
+
+	i = sync_hook_slot[sync_hook_slot_of(hash, sync_hook_seed)];
+	if (i-- == 0 || sync_hook_hash[i] != hash)
+		return NULL;
+
+	hook = &sync_hooks[i];
+	if (!(hook->flags & flags & sync_data.hooks) || strcmp(hook->name, name))
+		return NULL;
+	if ((flags & (SYNC_HOOK_GLX | SYNC_HOOK_EGL)) && hook->real && *hook->real == NULL)
+		return NULL;
+
+	return hook->func;
+}
+
+/**
+ * \brief lookup cache slot of (handle, name)
+ */
+static unsigned int sync_cache_slot(void *handle, uint32_t hash)
+{
+	return (hash ^ (uint32_t) ((uintptr_t) handle * 0x9e3779b1u)) & (SYNC_CACHE_ENTRIES - 1);
+}
+
+/**
+ * \brief finds cached lookup result without locking
+ * \return result or NULL on miss
+ */
+static void *sync_cache_get(void *handle, const char *name, uint32_t hash)
+{
+	const struct sync_cache_entry_s *e;
+	unsigned long generation;
+	unsigned int i, slot;
+	uint32_t seq;
+	void *result;
+
+	generation = __atomic_load_n(&sync_cache.generation, __ATOMIC_ACQUIRE);
+	slot = sync_cache_slot(handle, hash);
+	for (i = 0; i < SYNC_CACHE_PROBES; i++) {
+		e = &sync_cache.entry[(slot + i) & (SYNC_CACHE_ENTRIES - 1)];
+
+		seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		if (__atomic_load_n(&e->hash, __ATOMIC_RELAXED) != hash ||
+		    __atomic_load_n(&e->handle, __ATOMIC_RELAXED) != handle ||
+		    __atomic_load_n(&e->generation, __ATOMIC_RELAXED) != generation ||
+		    strncmp(e->name, name, SYNC_CACHE_NAME))
+			continue;
+		result = __atomic_load_n(&e->result, __ATOMIC_RELAXED);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) == seq)
+			return result;
 	}
 
-	eh_destroy_obj(&libdl);
+	return NULL;
+}
 
-	/* get glXSwapBuffers() using our pointer to dlsym() */
-	void *libGL_handle = dlopen("libGL.so.1", RTLD_LAZY);
-	if (libGL_handle == NULL) {
-		fprintf(stderr, "can't open libGL.so.1\n");
-		exit(1);
+/**
+ * \brief caches lookup result
+ *
+ * Takes the first stale slot among the probed ones, or evicts the first.
+ * Does nothing if another thread cached the same lookup meanwhile.
+ * \param generation sync_cache.generation read before the lookup, so a
+ *        result from a library dlclose()d meanwhile is stale right away
+ */
+static void sync_cache_put(void *handle, const char *name, uint32_t hash,
+			   void *result, unsigned long generation)
+{
+	struct sync_cache_entry_s *e = NULL, *probe;
+	unsigned int i, slot;
+	size_t len;
+
+	len = strlen(name);
+	if (len >= SYNC_CACHE_NAME)
+		return;
+
+	pthread_mutex_lock(&sync_cache.mutex);
+
+	slot = sync_cache_slot(handle, hash);
+	for (i = 0; i < SYNC_CACHE_PROBES; i++) {
+		probe = &sync_cache.entry[(slot + i) & (SYNC_CACHE_ENTRIES - 1)];
+		if (probe->generation != sync_cache.generation) {
+			if (e == NULL)
+				e = probe;
+			continue;
+		}
+
+		/* another thread missed on the same name and got here first */
+		if (probe->hash == hash && probe->handle == handle && !strcmp(probe->name, name)) {
+			pthread_mutex_unlock(&sync_cache.mutex);
+			return;
+		}
 	}
+	if (e == NULL)
+		e = &sync_cache.entry[slot];
 
-	sync_data->glXGetProcAddressARB = (GLXextFuncPtr (*)(const GLubyte*)) sync_data->dlsym(libGL_handle, "glXGetProcAddressARB");
-	if (sync_data->glXGetProcAddressARB == NULL) {
-		fprintf(stderr, "can't get glXGetProcAddressARB()\n");
-		exit(1);
+	__atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	__atomic_store_n(&e->hash, hash, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->handle, handle, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->generation, generation, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->result, result, __ATOMIC_RELAXED);
+	memcpy(e->name, name, len + 1);
+
+	__atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&sync_cache.mutex);
+}
+
+/**
+ * \brief forwards lookup through the cache
+ * \param resolve real lookup, called on a miss
+ */
+static void *sync_cache_resolve(void *handle, const char *name, uint32_t hash,
+				void *(*resolve)(void *, const char *))
+{
+	struct glsync_telemetry_s *tm = __atomic_load_n(&sync_data.telemetry, __ATOMIC_ACQUIRE);
+	unsigned long generation;
+	void *result;
+
+	result = sync_cache_get(handle, name, hash);
+	if (result) {
+		if (tm)
+			__atomic_fetch_add(&tm->lookup_hits, 1, __ATOMIC_RELAXED);
+		return result;
 	}
 
-	sync_data->glXSwapBuffers = (void (*)(Display*, GLXDrawable)) sync_data->dlsym(libGL_handle, "glXSwapBuffers");
-	if (sync_data->glXSwapBuffers == NULL) {
-		fprintf(stderr, "can't get glXSwapBuffers()\n");
-		exit(1);
+	generation = __atomic_load_n(&sync_cache.generation, __ATOMIC_ACQUIRE);
+	result = resolve(handle, name);
+	if (result)
+		sync_cache_put(handle, name, hash, result, generation);
+
+	if (tm)
+		__atomic_fetch_add(&tm->lookup_misses, 1, __ATOMIC_RELAXED);
+	return result;
+}
+
+/**
+ * \brief real glXGetProcAddressARB() in sync_cache_resolve() form
+ */
+static void *sync_glx_resolve(void *handle, const char *name)
+{
+	(void) handle;
+	return (void *) sync_data.glXGetProcAddressARB((const GLubyte *) name);
+}
+
+/**
+ * \brief real eglGetProcAddress() in sync_cache_resolve() form
+ */
+static void *sync_egl_resolve(void *handle, const char *name)
+{
+	(void) handle;
+	return (void *) sync_data.eglGetProcAddress(name);
+}
+
+/**
+ * \brief glXGetProcAddressARB() hook
+ */
+GLXextFuncPtr sync_glXGetProcAddressARB(const GLubyte *proc_name)
+{
+	uint32_t hash;
+	void *hook;
+
+	sync_init_gl();
+
+	hash = sync_hook_hash_name((const char *) proc_name);
+	hook = sync_hook_find((const char *) proc_name, hash, SYNC_HOOK_GLX);
+	if (hook)
+		return (GLXextFuncPtr) hook;
+
+	/* results do not depend on the current context */
+	return (GLXextFuncPtr) sync_cache_resolve(&sync_data.glXGetProcAddressARB, (const char *) proc_name,
+						   hash, sync_glx_resolve);
+}
+
+/**
+ * \brief eglGetProcAddress() hook
+ */
+EGLextFuncPtr sync_eglGetProcAddress(const char *proc_name)
+{
+	uint32_t hash;
+	void *hook;
+
+	sync_init_egl();
+
+	hash = sync_hook_hash_name(proc_name);
+	hook = sync_hook_find(proc_name, hash, SYNC_HOOK_EGL);
+	if (hook)
+		return (EGLextFuncPtr) hook;
+
+	return (EGLextFuncPtr) sync_cache_resolve(&sync_data.eglGetProcAddress, proc_name,
+						  hash, sync_egl_resolve);
+}
+
+#ifdef GLSYNC_GOT
+/**
+ * \brief patches GOT slots of one object, skipping glsync itself
+ */
+static int sync_got_patch_obj(eh_obj_t *obj, void *arg)
+{
+	ElfW(Addr) self = (ElfW(Addr)) &sync_got_patch_obj;
+	int p;
+
+	for (p = 0; p < obj->phnum; p++) {
+		if (obj->phdr[p].p_type == PT_LOAD &&
+		    self >= obj->addr + obj->phdr[p].p_vaddr &&
+		    self < obj->addr + obj->phdr[p].p_vaddr + obj->phdr[p].p_memsz)
+			return 0;
 	}
+
+	if (eh_set_rels(obj, arg))
+		fprintf(stderr, "glsync: can't patch %s\n", obj->name);
+	return 0;
 }
 
-void handleGLError(const char *call) {
-    GLenum err = glGetError();
-    if (err == GL_NO_ERROR)
-        return;
+/**
+ * \brief patches GOT slots of all loaded objects
+ *
+ * Slots already pointing to our hooks are skipped, so this is safe to run
+ * again after every dlopen().
+ * \return number of slots patched
+ */
+static unsigned int sync_got_patch(void)
+{
+	static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+	static eh_rel_patch_t patch[SYNC_HOOKS];
+	static eh_rel_set_t set;
+	static unsigned int npatch;
+	unsigned int i, before = 0, after = 0;
+
+	/* profile keeps GOT slots as they are */
+	if (!(sync_data.hooks & SYNC_HOOK_GOT))
+		return 0;
+
+	pthread_mutex_lock(&mutex);
+
+	if (set.index == NULL) {
+		for (i = 0; i < SYNC_HOOKS; i++) {
+			if (!(sync_hooks[i].flags & SYNC_HOOK_GOT))
+				continue;
+			patch[npatch].name = sync_hooks[i].name;
+			patch[npatch].val = sync_hooks[i].func;
+			npatch++;
+		}
+
+		if (eh_create_rel_set(&set, patch, npatch)) {
+			pthread_mutex_unlock(&mutex);
+			return 0;
+		}
+	}
+
+	for (i = 0; i < npatch; i++)
+		before += patch[i].count;
+	eh_iterate_obj(sync_got_patch_obj, &set);
+	for (i = 0; i < npatch; i++)
+		after += patch[i].count;
 
-    fprintf(stderr, "GL error on %s: %d\n", call, err);
+	pthread_mutex_unlock(&mutex);
+
+	return after - before;
 }
+#endif
 
 /**
- * \brief wrapped glXSwapBuffers that enforces sync with fence object.
+ * \brief dlopen() hook for GOT mode, patches newly loaded objects
  */
-void sync_glXSwapBuffers(Display* dpy, GLXDrawable drawable)
+void *sync_dlopen(const char *filename, int flag)
 {
-	if (sync_data == NULL)
-		init_sync_data();
+	void *handle;
+
+	handle = sync_data.dlopen(filename, flag);
+#ifdef GLSYNC_GOT
+	if (handle)
+		sync_got_patch();
+#endif
 
-        static int first = 1;
+	return handle;
+}
 
-        if (first) {
-            fprintf(stderr, "GLXFLUSH swap buf\n");
-            first = 0;
-        }
+/**
+ * \brief dlclose() hook, invalidates lookup cache
+ */
+int sync_dlclose(void *handle)
+{
+	int ret;
 
-        static GLsync prev_sync = 0;
-        GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-        handleGLError("glFenceSync");
-        sync_data->glXSwapBuffers(dpy, drawable);
-        handleGLError("glXSwapBuffers");
+	ret = sync_data.dlclose(handle);
 
-        if (prev_sync) {
-            glClientWaitSync(prev_sync, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
-            handleGLError("glWaitSync");
-            glDeleteSync(prev_sync);
-            handleGLError("glDeleteSync");
-        }
+	pthread_mutex_lock(&sync_cache.mutex);
+	__atomic_store_n(&sync_cache.generation, sync_cache.generation + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&sync_cache.mutex);
 
-        prev_sync = sync;
+	return ret;
 }
 
 /**
- * \brief glXGetProcAddressARB() hook
+ * \brief see glsync.h
  */
-GLXextFuncPtr sync_glXGetProcAddressARB(const GLubyte *proc_name)
+uint64_t glsync_frames_submitted(void)
 {
-	if (sync_data == NULL)
-		init_sync_data();
+	return __atomic_load_n(&sync_data.frames_submitted, __ATOMIC_RELAXED);
+}
 
-	if (!strcmp((char*) proc_name, "glXSwapBuffers"))
-		return (GLXextFuncPtr) &sync_glXSwapBuffers;
-	else if (!strcmp((char*) proc_name, "glXGetProcAddressARB"))
-		return (GLXextFuncPtr) &sync_glXGetProcAddressARB;
-	else
-		return sync_data->glXGetProcAddressARB(proc_name);
+/**
+ * \brief see glsync.h
+ */
+uint64_t glsync_frames_completed(void)
+{
+	return __atomic_load_n(&sync_data.frames_completed, __ATOMIC_RELAXED);
 }
 
+#ifndef GLSYNC_GOT
+
 /**
  * \brief glXSwapBuffers() entry point
  */
@@ -163,20 +3813,135 @@ GLXextFuncPtr glXGetProcAddressARB(const GLubyte *proc_name)
 	return sync_glXGetProcAddressARB(proc_name);
 }
 
+/**
+ * \brief glXGetProcAddress() entry point
+ */
+GLXextFuncPtr glXGetProcAddress(const GLubyte *proc_name)
+{
+	return sync_glXGetProcAddressARB(proc_name);
+}
+
+/**
+ * \brief eglSwapBuffers() entry point
+ */
+EGLBoolean eglSwapBuffers(EGLDisplay dpy, EGLSurface surface)
+{
+	return sync_eglSwapBuffers(dpy, surface);
+}
+
+/**
+ * \brief eglSwapBuffersWithDamageKHR() entry point
+ */
+EGLBoolean eglSwapBuffersWithDamageKHR(EGLDisplay dpy, EGLSurface surface,
+				       const EGLint *rects, EGLint nrects)
+{
+	return sync_eglSwapBuffersWithDamageKHR(dpy, surface, rects, nrects);
+}
+
+/**
+ * \brief eglSwapBuffersWithDamageEXT() entry point
+ */
+EGLBoolean eglSwapBuffersWithDamageEXT(EGLDisplay dpy, EGLSurface surface,
+				       const EGLint *rects, EGLint nrects)
+{
+	return sync_eglSwapBuffersWithDamageEXT(dpy, surface, rects, nrects);
+}
+
+/**
+ * \brief eglGetProcAddress() entry point
+ */
+EGLextFuncPtr eglGetProcAddress(const char *proc_name)
+{
+	return sync_eglGetProcAddress(proc_name);
+}
+
+/**
+ * \brief glXMakeCurrent() entry point
+ */
+Bool glXMakeCurrent(Display* dpy, GLXDrawable drawable, GLXContext ctx)
+{
+	return sync_glXMakeCurrent(dpy, drawable, ctx);
+}
+
+/**
+ * \brief glXMakeContextCurrent() entry point
+ */
+Bool glXMakeContextCurrent(Display* dpy, GLXDrawable draw, GLXDrawable read, GLXContext ctx)
+{
+	return sync_glXMakeContextCurrent(dpy, draw, read, ctx);
+}
+
+/**
+ * \brief glXDestroyContext() entry point
+ */
+void glXDestroyContext(Display* dpy, GLXContext ctx)
+{
+	sync_glXDestroyContext(dpy, ctx);
+}
+
+/**
+ * \brief glXSwapIntervalEXT() entry point
+ */
+void glXSwapIntervalEXT(Display *dpy, GLXDrawable drawable, int interval)
+{
+	sync_glXSwapIntervalEXT(dpy, drawable, interval);
+}
+
+/**
+ * \brief glXSwapIntervalMESA() entry point
+ */
+int glXSwapIntervalMESA(unsigned int interval)
+{
+	return sync_glXSwapIntervalMESA(interval);
+}
+
+/**
+ * \brief glXSwapIntervalSGI() entry point
+ */
+int glXSwapIntervalSGI(int interval)
+{
+	return sync_glXSwapIntervalSGI(interval);
+}
+
+/**
+ * \brief eglMakeCurrent() entry point
+ */
+EGLBoolean eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx)
+{
+	return sync_eglMakeCurrent(dpy, draw, read, ctx);
+}
+
+/**
+ * \brief eglDestroyContext() entry point
+ */
+EGLBoolean eglDestroyContext(EGLDisplay dpy, EGLContext ctx)
+{
+	return sync_eglDestroyContext(dpy, ctx);
+}
+
 /**
  * \brief dlsym() wrapper
+ *
+ * Hooked symbols are answered from the hook table, everything else is
+ * resolved by the real dlsym() through the lookup cache.
  */
 void *dlsym(void *handle, const char *symbol)
 {
-	if (sync_data == NULL)
-		init_sync_data();
+	uint32_t hash;
+	void *hook;
 
-	if (!strcmp(symbol, "glXSwapBuffers"))
-		return (void*) &sync_glXSwapBuffers;
-	else if (!strcmp(symbol, "glXGetProcAddressARB"))
-		return (void*) &sync_glXGetProcAddressARB;
-	else
-		return sync_data->dlsym(handle, symbol);
+	sync_init();
+
+	hash = sync_hook_hash_name(symbol);
+	hook = sync_hook_find(symbol, hash, SYNC_HOOK_DL);
+	if (hook)
+		return hook;
+
+	/* RTLD_NEXT depends on the calling object, never cache it */
+	if (handle == RTLD_NEXT || sync_data.off)
+		return sync_data.dlsym(handle, symbol);
+
+	return sync_cache_resolve(handle, symbol, hash, sync_data.dlsym);
 }
 
 /**
@@ -184,11 +3949,26 @@ void *dlsym(void *handle, const char *symbol)
  */
 void *dlvsym(void *handle, const char *symbol, const char *version)
 {
-	if (sync_data == NULL)
-		init_sync_data();
+	void *hook;
 
-	if (!strcmp(symbol, "glXSwapBuffers"))
-		return (void*) &sync_glXSwapBuffers;
-	else
-		return sync_data->dlvsym(handle, symbol, version);
+	sync_init();
+
+	/* versioned lookups are rare, not worth caching */
+	hook = sync_hook_find(symbol, sync_hook_hash_name(symbol), SYNC_HOOK_DL);
+	if (hook)
+		return hook;
+
+	return sync_data.dlvsym(handle, symbol, version);
+}
+
+/**
+ * \brief dlclose() wrapper, invalidates lookup cache
+ */
+int dlclose(void *handle)
+{
+	sync_init();
+
+	return sync_dlclose(handle);
 }
+
+#endif
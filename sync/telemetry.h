@@ -0,0 +1,160 @@
+/**
+ * \file sync/telemetry.h
+ * \brief frame telemetry shared memory layout
+ * \author Filip Volejnik <f.volejnik@centrum.cz>
+ * \date 2013
+ * For conditions of distribution and use, see copyright notice in elfhacks.h
+ */
+
+#ifndef GLSYNC_TELEMETRY_H
+#define GLSYNC_TELEMETRY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  \defgroup telemetry telemetry
+ *  With GLSYNC_TELEMETRY=1 every swap is recorded into a ring buffer in
+ *  POSIX shared memory named GLSYNC_TELEMETRY_NAME "<pid>".
+ *
+ *  Writers reserve a record by incrementing head, clear its seq, fill it
+ *  and publish it by storing frame index + 1 into seq with release
+ *  semantics. Readers accept a record only if seq holds the expected
+ *  value both before and after copying it out.
+ *  \{
+ */
+
+/** shared memory object name prefix, followed by pid */
+#define GLSYNC_TELEMETRY_NAME "/glsync."
+
+/** "GLSY" */
+#define GLSYNC_TELEMETRY_MAGIC 0x59534c47
+
+/** layout version, bumped on every change */
+#define GLSYNC_TELEMETRY_VERSION 1
+
+/** number of records in ring, power of two */
+#define GLSYNC_TELEMETRY_FRAMES 4096
+
+/**
+ * \brief depth controller decisions (GLSYNC_DEPTH=auto)
+ */
+enum glsync_depth_decision_e {
+	/** no decision on this frame */
+	GLSYNC_DEPTH_KEEP,
+	/** swaps stall the application, trying one more frame in flight */
+	GLSYNC_DEPTH_UP,
+	/** extra frame in flight looks unused, trying one less */
+	GLSYNC_DEPTH_DOWN,
+	/** last try cost throughput or gained none, undone */
+	GLSYNC_DEPTH_REVERT,
+	/** latency above GLSYNC_LATENCY_US, one less */
+	GLSYNC_DEPTH_CEILING
+};
+
+/**
+ * \brief one swap
+ *
+ * All durations are in nanoseconds.
+ */
+struct glsync_frame_s {
+	/** frame index + 1 once complete, 0 while being written */
+	uint64_t seq;
+
+	/** CLOCK_MONOTONIC time of swap entry */
+	uint64_t time;
+
+	/** swap chain (GLXDrawable or EGLSurface) this frame belongs to */
+	uint64_t chain;
+
+	/** time since previous swap of the same chain */
+	uint32_t frame_ns;
+
+	/** time application spent between previous swap and this one */
+	uint32_t cpu_ns;
+
+	/** time spent in the real swap */
+	uint32_t swap_ns;
+
+	/** time spent waiting for fences */
+	uint32_t wait_ns;
+
+	/** CPU time burnt while waiting for fences */
+	uint32_t wait_cpu_ns;
+
+	/** time spent in frame rate limiter */
+	uint32_t limit_ns;
+
+	/** GPU time of frame gpu_age swaps ago (GLSYNC_GPUTIME), 0 if no new result */
+	uint32_t gpu_ns;
+
+	/** how many swaps ago the frame measured by gpu_ns was swapped */
+	uint32_t gpu_age;
+
+	/** frames allowed in flight */
+	uint32_t depth;
+
+	/** jit mode: safety margin used to schedule next frame */
+	uint32_t margin_ns;
+
+	/** jit mode: actual minus predicted completion time of this frame */
+	int32_t error_ns;
+
+	/** auto depth: enum glsync_depth_decision_e taken on this frame, depth is the new one */
+	uint32_t decision;
+
+	/** auto depth: moving average of frame start to GPU completion */
+	uint32_t latency_ns;
+};
+
+/**
+ * \brief shared memory segment
+ */
+struct glsync_telemetry_s {
+	/** GLSYNC_TELEMETRY_MAGIC */
+	uint32_t magic;
+
+	/** GLSYNC_TELEMETRY_VERSION */
+	uint32_t version;
+
+	/** sizeof(struct glsync_frame_s) */
+	uint32_t frame_size;
+
+	/** GLSYNC_TELEMETRY_FRAMES */
+	uint32_t nframes;
+
+	/** number of records reserved so far, own cache line */
+	uint64_t head __attribute__ ((aligned (64)));
+
+	/** context switches seen in make-current calls */
+	uint64_t ctx_switches __attribute__ ((aligned (64)));
+
+	/** contexts destroyed */
+	uint64_t ctx_destroyed;
+
+	/** fences deleted without waiting because their context went away */
+	uint64_t fences_dropped;
+
+	/** dlsym() and get-proc-address lookups answered from cache */
+	uint64_t lookup_hits;
+
+	/** lookups forwarded to the real function */
+	uint64_t lookup_misses;
+
+	/** depth controller decisions other than GLSYNC_DEPTH_KEEP */
+	uint64_t depth_changes;
+
+	/** record ring, indexed by frame index % nframes */
+	struct glsync_frame_s frame[GLSYNC_TELEMETRY_FRAMES] __attribute__ ((aligned (64)));
+};
+
+/** \} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif